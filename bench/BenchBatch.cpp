@@ -0,0 +1,68 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+#include <helper/API.h>
+
+void Batch_Malloc_Loop(benchmark::State& state) {
+    std::vector<void*> objects(state.range_x());
+    while (state.KeepRunning()) {
+        for (void*& object : objects)
+            object = bmalloc::api::malloc(64);
+        for (void* object : objects)
+            bmalloc::api::free(object);
+    }
+}
+BENCHMARK(Batch_Malloc_Loop)->Arg(1 << 6)->Arg(1 << 10)->Arg(1 << 14);
+
+void Batch_Malloc_Batch(benchmark::State& state) {
+    std::vector<void*> objects(state.range_x());
+    while (state.KeepRunning()) {
+        bmalloc::api::batchMalloc(64, objects.size(), objects.data());
+        for (void* object : objects)
+            bmalloc::api::free(object);
+    }
+}
+BENCHMARK(Batch_Malloc_Batch)->Arg(1 << 6)->Arg(1 << 10)->Arg(1 << 14);
+
+void Batch_Free_Loop(benchmark::State& state) {
+    std::vector<void*> objects(state.range_x());
+    while (state.KeepRunning()) {
+        bmalloc::api::batchMalloc(64, objects.size(), objects.data());
+        for (void* object : objects)
+            bmalloc::api::free(object);
+    }
+}
+BENCHMARK(Batch_Free_Loop)->Arg(1 << 6)->Arg(1 << 10)->Arg(1 << 14);
+
+void Batch_Free_Batch(benchmark::State& state) {
+    std::vector<void*> objects(state.range_x());
+    while (state.KeepRunning()) {
+        bmalloc::api::batchMalloc(64, objects.size(), objects.data());
+        bmalloc::api::batchFree(objects.data(), objects.size());
+    }
+}
+BENCHMARK(Batch_Free_Batch)->Arg(1 << 6)->Arg(1 << 10)->Arg(1 << 14);
@@ -0,0 +1,77 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <bmalloc/Mutex.h>
+#include <mutex>
+#include <thread>
+
+// The lock StaticMutex used before it learned to park: spin on yield forever.
+class YieldSpinLock {
+public:
+    void lock()
+    {
+        while (m_flag.test_and_set(std::memory_order_acquire))
+            std::this_thread::yield();
+    }
+
+    void unlock() { m_flag.clear(std::memory_order_release); }
+
+private:
+    std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
+};
+
+static YieldSpinLock s_yieldSpinLock;
+static bmalloc::Mutex s_mutex;
+static volatile size_t s_counter;
+
+// Models a bmalloc critical section: a handful of dependent memory operations.
+template<typename LockType>
+static void lockUnlockLoop(benchmark::State& state, LockType& lock)
+{
+    while (state.KeepRunning()) {
+        std::lock_guard<LockType> guard(lock);
+        for (size_t i = 0; i < 16; ++i)
+            s_counter = s_counter + 1;
+    }
+}
+
+void Mutex_YieldSpinLock(benchmark::State& state)
+{
+    lockUnlockLoop(state, s_yieldSpinLock);
+}
+BENCHMARK(Mutex_YieldSpinLock)->ThreadRange(1, 128);
+
+void Mutex_StaticMutex(benchmark::State& state)
+{
+    lockUnlockLoop<bmalloc::StaticMutex>(state, s_mutex);
+    if (state.thread_index == 0) {
+        state.SetLabel(std::to_string(s_mutex.contendedLockCount()) + " contended, "
+            + std::to_string(s_mutex.parkCount()) + " parked");
+    }
+}
+BENCHMARK(Mutex_StaticMutex)->ThreadRange(1, 128);
@@ -102,6 +102,11 @@ template<typename T> inline constexpr size_t bitCount()
     return sizeof(T) * 8;
 }
 
+inline constexpr size_t log2(size_t value)
+{
+    return bitCount<size_t>() - 1 - __builtin_clzl(value);
+}
+
 } // namespace bmalloc
 
 #endif // Algorithm_h
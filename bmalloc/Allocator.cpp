@@ -27,12 +27,21 @@
 #include "BAssert.h"
 #include "Deallocator.h"
 #include "Heap.h"
+#include "HugeTLBPool.h"
 #include "LargeChunk.h"
 #include "LargeObject.h"
 #include "PerProcess.h"
+#include "PerShard.h"
 #include "Sizes.h"
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
+
+#if BOS(DARWIN)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
 
 using namespace std;
 
@@ -40,10 +49,15 @@ namespace bmalloc {
 
 Allocator::Allocator(Heap* heap, Deallocator& deallocator)
     : m_isBmallocEnabled(heap->environment().isBmallocEnabled())
+    , m_heap(heap)
     , m_deallocator(deallocator)
 {
-    for (unsigned short size = alignment; size <= mediumMax; size += alignment)
-        m_bumpAllocators[sizeClass(size)].init(size);
+    for (size_t sizeClass = 0; sizeClass < sizeClassCount; ++sizeClass)
+        m_bumpAllocators[sizeClass].init(objectSize(sizeClass));
+
+    m_refillPageCounts.fill(1);
+    m_refillSizes.fill(0);
+    m_cachedSize = 0;
 }
 
 Allocator::~Allocator()
@@ -59,11 +73,62 @@ void* Allocator::tryAllocate(size_t size)
     if (size <= largeMax)
         return allocate(size);
 
-    std::lock_guard<StaticMutex> lock(PerProcess<Heap>::mutex());
-    return PerProcess<Heap>::get()->tryAllocateXLarge(lock, superChunkSize, roundUpToMultipleOf<xLargeAlignment>(size));
+    return tryAllocateXLarge(superChunkSize, roundUpToMultipleOf<xLargeAlignment>(size));
 }
 
-void* Allocator::allocate(size_t alignment, size_t size)
+void* Allocator::allocateZeroed(size_t size)
+{
+    if (!m_isBmallocEnabled)
+        return calloc(1, size);
+
+    if (size <= mediumLargeMax) {
+        void* result = allocate(size);
+        memset(result, 0, size);
+        return result;
+    }
+
+    if (size <= largeMax) {
+        size = roundUpToMultipleOf<largeAlignment>(size);
+        bool isZeroed;
+        void* result;
+        {
+            std::lock_guard<StaticMutex> lock(m_heap->largeMutex());
+            result = m_heap->allocateLarge(lock, size, isZeroed);
+        }
+        if (!isZeroed)
+            memset(result, 0, size);
+        return result;
+    }
+
+    // XLarge objects are always freshly mapped.
+    return allocateXLarge(size);
+}
+
+NO_INLINE size_t Allocator::usableSizeSlowCase(void* object)
+{
+    if (!m_isBmallocEnabled) {
+#if BOS(DARWIN)
+        return malloc_size(object);
+#else
+        return malloc_usable_size(object);
+#endif
+    }
+
+    BASSERT(objectType(nullptr) == XLarge);
+    if (!object)
+        return 0;
+
+    Heap* heap = PerShard<Heap>::getFastCase(Heap::shard(object));
+    if (isXLarge(object)) {
+        std::unique_lock<StaticMutex> lock(heap->xLargeMutex());
+        return heap->findXLarge(lock, object).size();
+    }
+
+    std::lock_guard<StaticMutex> lock(heap->largeMutex());
+    return LargeObject(object).size();
+}
+
+void* Allocator::tryAllocate(size_t alignment, size_t size)
 {
     BASSERT(isPowerOfTwo(alignment));
 
@@ -74,37 +139,34 @@ void* Allocator::allocate(size_t alignment, size_t size)
         return result;
     }
     
-    if (size <= smallMax && alignment <= smallLineSize) {
-        size_t alignmentMask = alignment - 1;
-        while (void* p = allocate(size)) {
-            if (!test(p, alignmentMask))
-                return p;
-            m_deallocator.deallocate(p);
-        }
-    }
-
-    if (size <= mediumMax && alignment <= mediumLineSize) {
-        size = std::max(size, smallMax + Sizes::alignment);
-        size_t alignmentMask = alignment - 1;
-        while (void* p = allocate(size)) {
-            if (!test(p, alignmentMask))
-                return p;
-            m_deallocator.deallocate(p);
-        }
-    }
+    if (size_t alignedSize = alignedObjectSize(alignment, size))
+        return allocate(alignedSize);
 
     size = std::max(largeMin, roundUpToMultipleOf<largeAlignment>(size));
     alignment = roundUpToMultipleOf<largeAlignment>(alignment);
     size_t unalignedSize = largeMin + alignment + size;
     if (unalignedSize <= largeMax && alignment <= largeChunkSize / 2) {
-        std::lock_guard<StaticMutex> lock(PerProcess<Heap>::mutex());
-        return PerProcess<Heap>::getFastCase()->allocateLarge(lock, alignment, size, unalignedSize);
+        std::lock_guard<StaticMutex> lock(m_heap->largeMutex());
+        return m_heap->allocateLarge(lock, alignment, size, unalignedSize);
     }
 
     size = roundUpToMultipleOf<xLargeAlignment>(size);
     alignment = std::max(superChunkSize, alignment);
-    std::lock_guard<StaticMutex> lock(PerProcess<Heap>::mutex());
-    return PerProcess<Heap>::getFastCase()->allocateXLarge(lock, alignment, size);
+    return tryAllocateXLarge(alignment, size);
+}
+
+void* Allocator::allocate(size_t alignment, size_t size)
+{
+    void* result = tryAllocate(alignment, size);
+    RELEASE_BASSERT(result);
+    return result;
+}
+
+// A small, medium or medium-large object can grow or shrink in place as long
+// as the new size fits, and wastes no more than half the object.
+static bool canReallocateInPlace(size_t objectSize, size_t newSize)
+{
+    return newSize <= objectSize && newSize >= objectSize / 2;
 }
 
 void* Allocator::reallocate(void* object, size_t newSize)
@@ -117,19 +179,31 @@ void* Allocator::reallocate(void* object, size_t newSize)
     case Small: {
         SmallPage* page = SmallPage::get(SmallLine::get(object));
         oldSize = objectSize(page->sizeClass());
+        if (canReallocateInPlace(oldSize, newSize))
+            return object;
         break;
     }
     case Medium: {
         MediumPage* page = MediumPage::get(MediumLine::get(object));
         oldSize = objectSize(page->sizeClass());
+        if (canReallocateInPlace(oldSize, newSize))
+            return object;
+        break;
+    }
+    case MediumLarge: {
+        MediumLargePage* page = MediumLargePage::get(MediumLargeLine::get(object));
+        oldSize = objectSize(page->sizeClass());
+        if (canReallocateInPlace(oldSize, newSize))
+            return object;
         break;
     }
     case Large: {
-        std::unique_lock<StaticMutex> lock(PerProcess<Heap>::mutex());
+        Heap* heap = PerShard<Heap>::getFastCase(Heap::shard(object));
+        std::unique_lock<StaticMutex> lock(heap->largeMutex());
         LargeObject largeObject(object);
         oldSize = largeObject.size();
 
-        if (newSize < oldSize && newSize > mediumMax) {
+        if (newSize < oldSize && newSize > mediumLargeMax) {
             newSize = roundUpToMultipleOf<largeAlignment>(newSize);
             if (oldSize - newSize >= largeMin) {
                 std::pair<LargeObject, LargeObject> split = largeObject.split(newSize);
@@ -140,6 +214,11 @@ void* Allocator::reallocate(void* object, size_t newSize)
             }
             return object;
         }
+
+        if (newSize > oldSize && newSize <= largeMax) {
+            if (heap->extendLarge(lock, object, roundUpToMultipleOf<largeAlignment>(newSize)))
+                return object;
+        }
         break;
     }
     case XLarge: {
@@ -147,21 +226,41 @@ void* Allocator::reallocate(void* object, size_t newSize)
         if (!object)
             break;
 
-        std::unique_lock<StaticMutex> lock(PerProcess<Heap>::mutex());
-        Range& range = PerProcess<Heap>::getFastCase()->findXLarge(lock, object);
+        Heap* heap = PerShard<Heap>::getFastCase(Heap::shard(object));
+        std::unique_lock<StaticMutex> lock(heap->xLargeMutex());
+        XLargeRange& range = heap->findXLarge(lock, object);
         oldSize = range.size();
 
+        // The OS can't resize huge TLB mappings in place, or move them
+        // without copying, so we keep them when shrinking, and copy when
+        // growing.
+        if (range.isHugeTLB()) {
+            if (newSize <= oldSize && newSize > largeMax)
+                return object;
+            break;
+        }
+
         if (newSize < oldSize && newSize > largeMax) {
             newSize = roundUpToMultipleOf<xLargeAlignment>(newSize);
             if (oldSize - newSize >= xLargeAlignment) {
+                range = XLargeRange(object, newSize, false);
                 lock.unlock();
-                vmDeallocate(static_cast<char*>(object) + oldSize, oldSize - newSize);
-                lock.lock();
-
-                range = Range(object, newSize);
+                vmDeallocate(static_cast<char*>(object) + newSize, oldSize - newSize);
             }
             return object;
         }
+
+        if (newSize > oldSize) {
+            newSize = roundUpToMultipleOf<xLargeAlignment>(newSize);
+            if (tryVMExtend(object, oldSize, newSize)) {
+                range = XLargeRange(object, newSize, false);
+                return object;
+            }
+
+            lock.unlock();
+            if (void* result = tryMoveXLarge(object, oldSize, newSize))
+                return result;
+        }
         break;
     }
     }
@@ -173,11 +272,61 @@ void* Allocator::reallocate(void* object, size_t newSize)
     return result;
 }
 
+void* Allocator::tryMoveXLarge(void* object, size_t oldSize, size_t newSize)
+{
+    // XLarge objects must be aligned, so we reserve an aligned range and move
+    // our pages over it.
+    void* result = tryVMAllocate(superChunkSize, newSize);
+    if (!result)
+        return nullptr;
+
+    Heap* heap = PerShard<Heap>::getFastCase(Heap::shard(object));
+    {
+        std::unique_lock<StaticMutex> lock(heap->xLargeMutex());
+        if (!tryVMMove(object, oldSize, result, newSize)) {
+            lock.unlock();
+            vmDeallocate(result, newSize);
+            return nullptr;
+        }
+        heap->takeXLarge(lock, object);
+    }
+
+    // Our new address may belong to a different shard.
+    Heap* newHeap = PerShard<Heap>::get(Heap::shard(result));
+    std::lock_guard<StaticMutex> lock(newHeap->xLargeMutex());
+    newHeap->insertXLarge(lock, XLargeRange(result, newSize, false));
+    return result;
+}
+
+void Allocator::batchAllocate(size_t size, size_t count, void** objects)
+{
+    if (!m_isBmallocEnabled || size > mediumLargeMax) {
+        for (size_t i = 0; i < count; ++i)
+            objects[i] = allocate(size);
+        return;
+    }
+
+    size_t sizeClass = size <= mediumMax ? bmalloc::sizeClass(size) : mediumLargeSizeClass(size);
+    BumpAllocator& allocator = m_bumpAllocators[sizeClass];
+    for (size_t i = 0; i < count; ++i) {
+        if (!allocator.canAllocate())
+            allocator.refill(allocateBumpRange(sizeClass));
+        objects[i] = allocator.allocate();
+    }
+}
+
 void Allocator::scavenge()
 {
-    for (unsigned short i = alignment; i <= mediumMax; i += alignment) {
-        BumpAllocator& allocator = m_bumpAllocators[sizeClass(i)];
-        BumpRangeCache& bumpRangeCache = m_bumpRangeCaches[sizeClass(i)];
+    for (size_t sizeClass = 0; sizeClass < sizeClassCount; ++sizeClass) {
+        BumpAllocator& allocator = m_bumpAllocators[sizeClass];
+        BumpRangeCache& bumpRangeCache = m_bumpRangeCaches[sizeClass];
+
+        // Our unused ranges still reference their lines, so another thread can
+        // allocate from them as is. We free whatever the transfer cache can't take.
+        if (allocator.canAllocate() && bumpRangeCache.size() != bumpRangeCache.capacity())
+            bumpRangeCache.push(allocator.take());
+        if (bumpRangeCache.size())
+            m_heap->transferCache(sizeClass).tryPush(bumpRangeCache);
 
         while (allocator.canAllocate())
             m_deallocator.deallocate(allocator.allocate());
@@ -190,17 +339,68 @@ void Allocator::scavenge()
 
         allocator.clear();
     }
+
+    m_refillSizes.fill(0);
+    m_cachedSize = 0;
+}
+
+size_t Allocator::refillPageCount(size_t sizeClass)
+{
+    size_t pageCount = slowStartRefillPageCount(
+        m_refillPageCounts[sizeClass], m_refillTimes[sizeClass], std::chrono::steady_clock::now());
+    size_t pageSize = sizeClass < mediumSizeClassCount ? vmPageSize : mediumLargePageSize;
+    return budgetedRefillPageCount(pageCount, pageSize, m_cachedSize);
+}
+
+size_t Allocator::refillBumpRangeCache(size_t sizeClass, BumpRangeCache& bumpRangeCache, size_t pageCount)
+{
+    if (sizeClass <= bmalloc::sizeClass(smallMax)) {
+        std::lock_guard<StaticMutex> lock(m_heap->smallMutex(sizeClass));
+        return m_heap->refillSmallBumpRangeCache(lock, sizeClass, bumpRangeCache, pageCount);
+    }
+
+    if (sizeClass < mediumSizeClassCount) {
+        std::lock_guard<StaticMutex> lock(m_heap->mediumMutex(sizeClass));
+        return m_heap->refillMediumBumpRangeCache(lock, sizeClass, bumpRangeCache, pageCount);
+    }
+
+    std::lock_guard<StaticMutex> lock(m_heap->mediumLargeMutex(sizeClass));
+    return m_heap->refillMediumLargeBumpRangeCache(lock, sizeClass, bumpRangeCache, pageCount);
 }
 
 NO_INLINE BumpRange Allocator::allocateBumpRangeSlowCase(size_t sizeClass)
 {
     BumpRangeCache& bumpRangeCache = m_bumpRangeCaches[sizeClass];
 
-    std::lock_guard<StaticMutex> lock(PerProcess<Heap>::mutex());
-    if (sizeClass <= bmalloc::sizeClass(smallMax))
-        PerProcess<Heap>::getFastCase()->refillSmallBumpRangeCache(lock, sizeClass, bumpRangeCache);
-    else
-        PerProcess<Heap>::getFastCase()->refillMediumBumpRangeCache(lock, sizeClass, bumpRangeCache);
+    // We've used up our previous refill.
+    m_cachedSize -= m_refillSizes[sizeClass];
+
+    TransferCache& transferCache = m_heap->transferCache(sizeClass);
+    if (!transferCache.tryPop(bumpRangeCache)) {
+        // Objects that other shards freed on our behalf may have freed up lines.
+        m_heap->processRemoteFrees();
+
+        // Whatever doesn't fit goes to the transfer cache, so our next refill,
+        // or another thread's, can take it without scanning a page.
+        size_t pageCount = refillBumpRangeCache(sizeClass, bumpRangeCache, refillPageCount(sizeClass));
+        if (pageCount && !transferCache.isFull()) {
+            BumpRangeCache surplus;
+            refillBumpRangeCache(sizeClass, surplus, pageCount);
+            if (!transferCache.tryPush(surplus)) {
+                for (auto& bumpRange : surplus) {
+                    char* object = bumpRange.begin;
+                    for (unsigned short i = 0; i < bumpRange.objectCount; ++i, object += objectSize(sizeClass))
+                        m_deallocator.deallocate(object);
+                }
+            }
+        }
+    }
+
+    size_t objectCount = 0;
+    for (auto& bumpRange : bumpRangeCache)
+        objectCount += bumpRange.objectCount;
+    m_refillSizes[sizeClass] = objectCount * objectSize(sizeClass);
+    m_cachedSize += m_refillSizes[sizeClass];
 
     return bumpRangeCache.pop();
 }
@@ -216,15 +416,45 @@ INLINE BumpRange Allocator::allocateBumpRange(size_t sizeClass)
 NO_INLINE void* Allocator::allocateLarge(size_t size)
 {
     size = roundUpToMultipleOf<largeAlignment>(size);
-    std::lock_guard<StaticMutex> lock(PerProcess<Heap>::mutex());
-    return PerProcess<Heap>::getFastCase()->allocateLarge(lock, size);
+    std::lock_guard<StaticMutex> lock(m_heap->largeMutex());
+    return m_heap->allocateLarge(lock, size);
+}
+
+void* Allocator::tryAllocateXLarge(size_t alignment, size_t size)
+{
+    BASSERT(isPowerOfTwo(alignment));
+    BASSERT(alignment >= superChunkSize);
+    BASSERT(size == roundUpToMultipleOf<xLargeAlignment>(size));
+
+    // The owning shard is a function of the address, so we map the memory
+    // before taking any lock.
+    XLargeRange range;
+    Range hugeTLBRange = PerProcess<HugeTLBPool>::get()->tryAllocate(alignment, size);
+    if (!hugeTLBRange) {
+        void* result = tryVMAllocate(alignment, size);
+        if (!result)
+            return nullptr;
+        range = XLargeRange(result, size, false);
+    } else
+        range = XLargeRange(hugeTLBRange.begin(), hugeTLBRange.size(), true);
+
+    Heap* heap = PerShard<Heap>::get(Heap::shard(range.begin()));
+    std::lock_guard<StaticMutex> lock(heap->xLargeMutex());
+    heap->insertXLarge(lock, range);
+    return range.begin();
+}
+
+void* Allocator::allocateXLarge(size_t alignment, size_t size)
+{
+    void* result = tryAllocateXLarge(alignment, size);
+    RELEASE_BASSERT(result);
+    return result;
 }
 
 NO_INLINE void* Allocator::allocateXLarge(size_t size)
 {
     size = roundUpToMultipleOf<xLargeAlignment>(size);
-    std::lock_guard<StaticMutex> lock(PerProcess<Heap>::mutex());
-    return PerProcess<Heap>::getFastCase()->allocateXLarge(lock, size);
+    return allocateXLarge(superChunkSize, size);
 }
 
 void* Allocator::allocateSlowCase(size_t size)
@@ -232,8 +462,8 @@ void* Allocator::allocateSlowCase(size_t size)
     if (!m_isBmallocEnabled)
         return malloc(size);
 
-    if (size <= mediumMax) {
-        size_t sizeClass = bmalloc::sizeClass(size);
+    if (size <= mediumLargeMax) {
+        size_t sizeClass = size <= mediumMax ? bmalloc::sizeClass(size) : mediumLargeSizeClass(size);
         BumpAllocator& allocator = m_bumpAllocators[sizeClass];
         allocator.refill(allocateBumpRange(sizeClass));
         return allocator.allocate();
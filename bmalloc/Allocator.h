@@ -27,7 +27,12 @@
 #define Allocator_h
 
 #include "BumpAllocator.h"
+#include "MediumChunk.h"
+#include "MediumLargeChunk.h"
+#include "ObjectType.h"
+#include "SmallChunk.h"
 #include <array>
+#include <chrono>
 
 namespace bmalloc {
 
@@ -43,35 +48,69 @@ public:
 
     void* tryAllocate(size_t);
     void* allocate(size_t);
+    void* tryAllocate(size_t alignment, size_t);
     void* allocate(size_t alignment, size_t);
     void* reallocate(void*, size_t);
 
+    // Like allocate, but zero-fills the object, skipping memory that is known
+    // to be zero already.
+    void* allocateZeroed(size_t);
+
+    // Returns how many bytes the object can hold. Doesn't take a lock for
+    // small, medium and medium-large objects.
+    size_t usableSize(void*);
+
+    // Fills objects with count objects of the given size.
+    void batchAllocate(size_t, size_t count, void** objects);
+
     void scavenge();
 
 private:
     bool allocateFastCase(size_t, void*&);
     void* allocateSlowCase(size_t);
     
+    size_t usableSizeSlowCase(void*);
+
     void* allocateMedium(size_t);
     void* allocateLarge(size_t);
     void* allocateXLarge(size_t);
+    void* allocateXLarge(size_t alignment, size_t);
+    void* tryAllocateXLarge(size_t alignment, size_t);
+    void* tryMoveXLarge(void*, size_t oldSize, size_t newSize);
     
     BumpRange allocateBumpRange(size_t sizeClass);
     BumpRange allocateBumpRangeSlowCase(size_t sizeClass);
+    size_t refillPageCount(size_t sizeClass);
+    size_t refillBumpRangeCache(size_t sizeClass, BumpRangeCache&, size_t pageCount);
     
-    std::array<BumpAllocator, mediumMax / alignment> m_bumpAllocators;
-    std::array<BumpRangeCache, mediumMax / alignment> m_bumpRangeCaches;
+    std::array<BumpAllocator, sizeClassCount> m_bumpAllocators;
+    std::array<BumpRangeCache, sizeClassCount> m_bumpRangeCaches;
+
+    // Each size class's refill size adapts to how often it refills.
+    std::array<unsigned char, sizeClassCount> m_refillPageCounts;
+    std::array<std::chrono::steady_clock::time_point, sizeClassCount> m_refillTimes;
+
+    // Bytes in each size class's most recent refill, which bounds what it
+    // has cached, and their sum.
+    std::array<size_t, sizeClassCount> m_refillSizes;
+    size_t m_cachedSize;
 
     bool m_isBmallocEnabled;
+    Heap* m_heap;
     Deallocator& m_deallocator;
 };
 
 inline bool Allocator::allocateFastCase(size_t size, void*& object)
 {
-    if (size > mediumMax)
+    size_t sizeClass;
+    if (size <= mediumMax)
+        sizeClass = bmalloc::sizeClass(size);
+    else if (size <= mediumLargeMax)
+        sizeClass = mediumLargeSizeClass(size);
+    else
         return false;
 
-    BumpAllocator& allocator = m_bumpAllocators[sizeClass(size)];
+    BumpAllocator& allocator = m_bumpAllocators[sizeClass];
     if (!allocator.canAllocate())
         return false;
 
@@ -87,6 +126,18 @@ inline void* Allocator::allocate(size_t size)
     return object;
 }
 
+inline size_t Allocator::usableSize(void* object)
+{
+    if (!m_isBmallocEnabled || !isSmallOrMedium(object))
+        return usableSizeSlowCase(object);
+
+    if (isMediumLarge(object))
+        return objectSize(MediumLargePage::get(MediumLargeLine::get(object))->sizeClass());
+    if (isSmall(object))
+        return objectSize(SmallPage::get(SmallLine::get(object))->sizeClass());
+    return objectSize(MediumPage::get(MediumLine::get(object))->sizeClass());
+}
+
 } // namespace bmalloc
 
 #endif // Allocator_h
@@ -28,9 +28,10 @@
 
 #include "BAssert.h"
 #include "Inline.h"
-#include "Mutex.h"
 #include <atomic>
 #include <condition_variable>
+#include <mutex>
+#include <new>
 #include <pthread.h>
 #include <thread>
 
@@ -44,6 +45,11 @@ public:
     void run();
     void join();
 
+    // fork() support. The child has no thread, so it starts over.
+    void forkPrepare();
+    void forkParent();
+    void forkChild();
+
 private:
     enum State { Exited, Sleeping, Running, Signaled };
 
@@ -56,8 +62,10 @@ private:
 
     std::atomic<State> m_state;
 
-    Mutex m_conditionMutex;
-    std::condition_variable_any m_condition;
+    // Unlike std::condition_variable_any, these don't allocate, so we can
+    // recreate them in a forked child.
+    std::mutex m_conditionMutex;
+    std::condition_variable m_condition;
     pthread_t m_thread;
 
     Object& m_object;
@@ -82,13 +90,35 @@ void AsyncTask<Object, Function>::join()
     if (m_state == Exited)
         return;
 
-    { std::lock_guard<Mutex> lock(m_conditionMutex); }
+    { std::lock_guard<std::mutex> lock(m_conditionMutex); }
     m_condition.notify_one();
 
     while (m_state != Exited)
         std::this_thread::yield();
 }
 
+template<typename Object, typename Function>
+void AsyncTask<Object, Function>::forkPrepare()
+{
+    m_conditionMutex.lock();
+}
+
+template<typename Object, typename Function>
+void AsyncTask<Object, Function>::forkParent()
+{
+    m_conditionMutex.unlock();
+}
+
+template<typename Object, typename Function>
+void AsyncTask<Object, Function>::forkChild()
+{
+    // Our thread may have been using the mutex or waiting on the condition, so
+    // neither is safe to reuse.
+    new (&m_conditionMutex) std::mutex();
+    new (&m_condition) std::condition_variable();
+    m_state = Exited;
+}
+
 template<typename Object, typename Function>
 inline void AsyncTask<Object, Function>::run()
 {
@@ -105,7 +135,7 @@ NO_INLINE void AsyncTask<Object, Function>::runSlowCase()
         return;
 
     if (oldState == Sleeping) {
-        { std::lock_guard<Mutex> lock(m_conditionMutex); }
+        { std::lock_guard<std::mutex> lock(m_conditionMutex); }
         m_condition.notify_one();
         return;
     }
@@ -132,7 +162,7 @@ void AsyncTask<Object, Function>::entryPoint()
 
         expectedState = Running;
         if (m_state.compare_exchange_weak(expectedState, Sleeping)) {
-            std::unique_lock<Mutex> lock(m_conditionMutex);
+            std::unique_lock<std::mutex> lock(m_conditionMutex);
             m_condition.wait_for(lock, exitDelay, [=]() { return this->m_state != Sleeping; });
         }
 
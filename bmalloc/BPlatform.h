@@ -32,6 +32,7 @@
 
 #define BPLATFORM(PLATFORM) (defined BPLATFORM_##PLATFORM && BPLATFORM_##PLATFORM)
 #define BOS(OS) (defined BOS_##OS && BOS_##OS)
+#define BCPU(CPU) (defined BCPU_##CPU && BCPU_##CPU)
 
 #if ((defined(TARGET_OS_EMBEDDED) && TARGET_OS_EMBEDDED) \
     || (defined(TARGET_OS_IPHONE) && TARGET_OS_IPHONE) \
@@ -43,4 +44,16 @@
 #define BOS_DARWIN 1
 #endif
 
+#ifdef __linux__
+#define BOS_LINUX 1
+#endif
+
+#if defined(__x86_64__)
+#define BCPU_X86_64 1
+#endif
+
+#if defined(__aarch64__)
+#define BCPU_ARM64 1
+#endif
+
 #endif // BPlatform_h
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#include "BootstrapArena.h"
+#include <mutex>
+
+namespace bmalloc {
+
+StaticMutex BootstrapArena::s_mutex;
+size_t BootstrapArena::s_bumpOffset;
+BootstrapArena::FreeObject* BootstrapArena::s_freeLists[sizeClassCount];
+alignas(vmPageSize) char BootstrapArena::s_memory[arenaSize];
+
+void* BootstrapArena::allocate(size_t alignment, size_t size)
+{
+    BASSERT(isPowerOfTwo(alignment));
+    alignment = max(alignment, sizeof(Header));
+    if (size > arenaSize || alignment > arenaSize)
+        return nullptr;
+
+    // Blocks are aligned to sizeof(Header), so the header and the padding
+    // that aligns the object take at most alignment bytes.
+    size_t neededSize = alignment + size;
+    size_t sizeClass = 0;
+    while (blockSize(sizeClass) < neededSize) {
+        if (++sizeClass == sizeClassCount)
+            return nullptr;
+    }
+
+    char* block;
+    {
+        std::lock_guard<StaticMutex> lock(s_mutex);
+        if (FreeObject* freeObject = s_freeLists[sizeClass]) {
+            s_freeLists[sizeClass] = freeObject->next;
+            block = reinterpret_cast<char*>(freeObject);
+        } else {
+            if (arenaSize - s_bumpOffset < blockSize(sizeClass))
+                return nullptr;
+            block = s_memory + s_bumpOffset;
+            s_bumpOffset += blockSize(sizeClass);
+        }
+    }
+
+    char* object = roundUpToMultipleOf(alignment, block + sizeof(Header));
+    Header* header = BootstrapArena::header(object);
+    header->block = block;
+    header->sizeClass = sizeClass;
+    return object;
+}
+
+void BootstrapArena::deallocate(void* object)
+{
+    Header* header = BootstrapArena::header(object);
+    FreeObject* freeObject = reinterpret_cast<FreeObject*>(header->block);
+    size_t sizeClass = header->sizeClass;
+
+    std::lock_guard<StaticMutex> lock(s_mutex);
+    freeObject->next = s_freeLists[sizeClass];
+    s_freeLists[sizeClass] = freeObject;
+}
+
+size_t BootstrapArena::usableSize(void* object)
+{
+    Header* header = BootstrapArena::header(object);
+    return header->block + blockSize(header->sizeClass) - static_cast<char*>(object);
+}
+
+} // namespace bmalloc
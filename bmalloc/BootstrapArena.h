@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#ifndef BootstrapArena_h
+#define BootstrapArena_h
+
+#include "Sizes.h"
+#include "StaticMutex.h"
+
+namespace bmalloc {
+
+// A small, slow allocator in static storage, for allocations that bmalloc
+// can't serve when it replaces the system malloc: those made before the
+// replacement is initialized, and those made by code that bmalloc calls into
+// while it may hold its own locks, like pthread_create.
+
+class BootstrapArena {
+public:
+    static bool contains(void*);
+
+    // Returns null on failure.
+    static void* allocate(size_t alignment, size_t);
+    static void deallocate(void*);
+
+    // Returns how many bytes the object can hold.
+    static size_t usableSize(void*);
+
+    // fork() support.
+    static void forkPrepare() { s_mutex.lock(); }
+    static void forkParent() { s_mutex.unlock(); }
+    static void forkChild() { s_mutex.unlock(); }
+
+private:
+    struct FreeObject {
+        FreeObject* next;
+    };
+
+    // Precedes every object, so we can find its block.
+    struct Header {
+        char* block;
+        size_t sizeClass;
+    };
+
+    static const size_t arenaSize = 4 * MB;
+    static const size_t minBlockSize = 32;
+    static const size_t sizeClassCount = log2(arenaSize / minBlockSize) + 1;
+
+    static Header* header(void*);
+    static size_t blockSize(size_t sizeClass) { return minBlockSize << sizeClass; }
+
+    static StaticMutex s_mutex;
+    static size_t s_bumpOffset;
+    static FreeObject* s_freeLists[sizeClassCount];
+    alignas(vmPageSize) static char s_memory[arenaSize];
+};
+
+inline bool BootstrapArena::contains(void* object)
+{
+    char* p = static_cast<char*>(object);
+    return p >= s_memory && p < s_memory + arenaSize;
+}
+
+inline auto BootstrapArena::header(void* object) -> Header*
+{
+    BASSERT(contains(object));
+    return static_cast<Header*>(object) - 1;
+}
+
+} // namespace bmalloc
+
+#endif // BootstrapArena_h
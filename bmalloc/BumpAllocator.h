@@ -32,7 +32,7 @@
 
 namespace bmalloc {
 
-// Helper object for allocating small and medium objects.
+// Helper object for allocating small, medium and medium-large objects.
 
 class BumpAllocator {
 public:
@@ -49,6 +49,9 @@ public:
 
     void refill(const BumpRange&);
 
+    // Returns the range of objects we haven't allocated yet, and clears it.
+    BumpRange take();
+
 private:
     void validate(void*);
 
@@ -79,8 +82,13 @@ inline void BumpAllocator::validate(void* ptr)
         return;
     }
     
-    BASSERT(m_size <= mediumMax);
-    BASSERT(isMedium(ptr));
+    if (m_size <= mediumMax) {
+        BASSERT(isMedium(ptr));
+        return;
+    }
+
+    BASSERT(m_size <= mediumLargeMax);
+    BASSERT(isMediumLarge(ptr));
 }
 
 inline void* BumpAllocator::allocate()
@@ -101,6 +109,13 @@ inline void BumpAllocator::refill(const BumpRange& bumpRange)
     m_remaining = bumpRange.objectCount;
 }
 
+inline BumpRange BumpAllocator::take()
+{
+    BumpRange bumpRange = { m_ptr, m_remaining };
+    clear();
+    return bumpRange;
+}
+
 inline void BumpAllocator::clear()
 {
     m_ptr = nullptr;
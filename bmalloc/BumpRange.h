@@ -29,6 +29,8 @@
 #include "FixedVector.h"
 #include "Range.h"
 #include "Sizes.h"
+#include <algorithm>
+#include <chrono>
 
 namespace bmalloc {
 
@@ -39,6 +41,28 @@ struct BumpRange {
 
 typedef FixedVector<BumpRange, bumpRangeCacheCapacity> BumpRangeCache;
 
+// Slow start: a refill soon after the previous one takes twice as many pages.
+// A refill after a quiet period decays back toward one page. Updates the size
+// class's page count and refill time.
+inline size_t slowStartRefillPageCount(unsigned char& pageCount, std::chrono::steady_clock::time_point& refillTime, std::chrono::steady_clock::time_point now)
+{
+    if (now - refillTime < bumpRangeCacheRefillInterval)
+        pageCount = std::min<size_t>(pageCount * 2, bumpRangeCacheRefillPageCountMax);
+    else
+        pageCount = std::max(pageCount / 2, 1);
+    refillTime = now;
+    return pageCount;
+}
+
+// Halves a refill until it fits in a thread's budget for cached bytes, on top
+// of what the thread has cached already. Takes at least one page.
+inline size_t budgetedRefillPageCount(size_t pageCount, size_t pageSize, size_t cachedSize)
+{
+    while (pageCount > 1 && cachedSize + pageCount * pageSize > bumpRangeCacheBudget)
+        pageCount /= 2;
+    return pageCount;
+}
+
 } // namespace bmalloc
 
 #endif // BumpRange_h
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#include "CPUCache.h"
+
+#if HAVE_RSEQ
+
+#include "Cache.h"
+#include "Heap.h"
+#include "PerShard.h"
+#include "VMAllocate.h"
+#include <sched.h>
+#include <unistd.h>
+
+namespace bmalloc {
+
+std::atomic<bool> CPUCache::s_isEnabled;
+bool CPUCache::s_isInitialized;
+StaticMutex CPUCache::s_mutex;
+CPUCache* CPUCache::s_caches;
+size_t CPUCache::s_cpuCount;
+
+CPUCache::CPUCache(Heap* heap)
+    : m_bumpWords()
+    , m_objectLogSize(0)
+    , m_heap(heap)
+{
+}
+
+bool CPUCache::initialize()
+{
+    std::lock_guard<StaticMutex> lock(s_mutex);
+    if (s_isInitialized)
+        return isEnabled();
+    s_isInitialized = true;
+
+    if (!PerShard<Heap>::get(0)->environment().isPerCPUCacheEnabled())
+        return false;
+
+    // glibc registers rseq for every thread it creates, unless the kernel is
+    // too old or the application opted out with glibc.pthread.rseq=0.
+    if (rseqCurrentCPU() < 0)
+        return false;
+
+    long cpuCount = sysconf(_SC_NPROCESSORS_CONF);
+    if (cpuCount <= 0)
+        return false;
+
+    // CPU i is bound to shard i % heapShardCount, for the life of the process.
+    CPUCache* caches = static_cast<CPUCache*>(vmAllocate(vmSize(cpuCount * sizeof(CPUCache))));
+    for (long cpu = 0; cpu < cpuCount; ++cpu)
+        new (&caches[cpu]) CPUCache(PerShard<Heap>::get(cpu % heapShardCount));
+
+    s_caches = caches;
+    s_cpuCount = cpuCount;
+    s_isEnabled.store(true, std::memory_order_release);
+    return true;
+}
+
+NO_INLINE void* CPUCache::allocateSlowCase(size_t sizeClass)
+{
+    while (true) {
+        int cpu = rseqCurrentCPU();
+        if (static_cast<size_t>(cpu) >= s_cpuCount)
+            return PerThread<Cache>::get()->allocator().allocate(objectSize(sizeClass));
+
+        CPUCache& cache = s_caches[cpu];
+        void* object;
+        RseqResult result = rseqBumpAllocate(cpu, &cache.m_bumpWords[sizeClass], objectSize(sizeClass), object);
+        if (result == RseqResult::Committed)
+            return object;
+        if (result == RseqResult::Aborted)
+            continue;
+
+        return cache.refillAndAllocate(cpu, sizeClass);
+    }
+}
+
+void* CPUCache::refillAndAllocate(int cpu, size_t sizeClass)
+{
+    std::lock_guard<StaticMutex> lock(m_mutex);
+
+    BumpRangeCache& bumpRangeCache = m_bumpRangeCaches[sizeClass];
+    if (!bumpRangeCache.size() && !m_heap->transferCache(sizeClass).tryPop(bumpRangeCache)) {
+        m_heap->processRemoteFrees();
+        if (sizeClass <= bmalloc::sizeClass(smallMax)) {
+            std::lock_guard<StaticMutex> heapLock(m_heap->smallMutex(sizeClass));
+            m_heap->refillSmallBumpRangeCache(heapLock, sizeClass, bumpRangeCache, 1);
+        } else {
+            std::lock_guard<StaticMutex> heapLock(m_heap->mediumMutex(sizeClass));
+            m_heap->refillMediumBumpRangeCache(heapLock, sizeClass, bumpRangeCache, 1);
+        }
+    }
+
+    BumpRange bumpRange = bumpRangeCache.pop();
+    void* object = bumpRange.begin;
+    bumpRange.begin += objectSize(sizeClass);
+    if (!--bumpRange.objectCount)
+        return object;
+
+    // If we've migrated, or another thread on this CPU refilled first, keep
+    // the rest of the range for later.
+    uint64_t word = makeBumpWord(bumpRange.begin, bumpRange.objectCount);
+    RseqResult result;
+    do {
+        result = rseqBumpRefill(cpu, &m_bumpWords[sizeClass], word);
+    } while (result == RseqResult::Aborted && rseqCurrentCPU() == cpu);
+
+    if (result != RseqResult::Committed)
+        bumpRangeCache.push(bumpRange);
+    return object;
+}
+
+NO_INLINE void CPUCache::deallocateSlowCase(void* object)
+{
+    while (true) {
+        int cpu = rseqCurrentCPU();
+        if (static_cast<size_t>(cpu) >= s_cpuCount) {
+            PerThread<Cache>::get()->deallocator().deallocate(object);
+            return;
+        }
+
+        CPUCache& cache = s_caches[cpu];
+        RseqResult result = rseqPush(cpu, &cache.m_objectLogSize, cache.m_objectLog.data(), deallocatorLogCapacity, object);
+        if (result == RseqResult::Committed)
+            return;
+        if (result == RseqResult::Aborted)
+            continue;
+
+        cache.processObjectLog(cpu);
+    }
+}
+
+void CPUCache::processObjectLog(int cpu)
+{
+    // Other threads may push to this CPU's log while we drain it, so we pop
+    // objects one at a time into a private log.
+    Deallocator::ObjectLog objectLog;
+    while (objectLog.size() != objectLog.capacity()) {
+        void* object;
+        RseqResult result = rseqPop(cpu, &m_objectLogSize, m_objectLog.data(), object);
+        if (result == RseqResult::Failed)
+            break;
+        if (result == RseqResult::Aborted) {
+            if (rseqCurrentCPU() != cpu)
+                break;
+            continue;
+        }
+        objectLog.push(object);
+    }
+
+    Deallocator::processObjectLog(objectLog, m_heap);
+}
+
+static void logObject(Deallocator::ObjectLog& objectLog, void* object)
+{
+    if (objectLog.size() == objectLog.capacity())
+        Deallocator::processObjectLog(objectLog, nullptr);
+    objectLog.push(object);
+}
+
+static void logBumpRange(Deallocator::ObjectLog& objectLog, BumpRange bumpRange, size_t size)
+{
+    for (; bumpRange.objectCount; --bumpRange.objectCount, bumpRange.begin += size)
+        logObject(objectLog, bumpRange.begin);
+}
+
+void CPUCache::scavenge(int cpu, Deallocator::ObjectLog& objectLog)
+{
+    // Bump words and the object log are only reachable by running on their CPU.
+    // Stop as soon as we migrate; anything we miss is picked up next time.
+    while (m_objectLogSize) {
+        void* object;
+        RseqResult result = rseqPop(cpu, &m_objectLogSize, m_objectLog.data(), object);
+        if (result == RseqResult::Aborted && rseqCurrentCPU() != cpu)
+            return;
+        if (result == RseqResult::Committed)
+            logObject(objectLog, object);
+    }
+
+    for (size_t sizeClass = 0; sizeClass < m_bumpWords.size(); ++sizeClass) {
+        uint64_t word;
+        RseqResult result;
+        do {
+            result = rseqBumpTake(cpu, &m_bumpWords[sizeClass], word);
+        } while (result == RseqResult::Aborted && rseqCurrentCPU() == cpu);
+
+        if (result != RseqResult::Committed)
+            return;
+
+        BumpRange bumpRange;
+        bumpRange.begin = reinterpret_cast<char*>(word & bumpWordPointerMask);
+        bumpRange.objectCount = word >> bumpWordCountShift;
+        logBumpRange(objectLog, bumpRange, objectSize(sizeClass));
+    }
+}
+
+void CPUCache::scavengeBumpRangeCaches(Deallocator::ObjectLog& objectLog)
+{
+    std::lock_guard<StaticMutex> lock(m_mutex);
+    for (size_t sizeClass = 0; sizeClass < m_bumpRangeCaches.size(); ++sizeClass) {
+        BumpRangeCache& bumpRangeCache = m_bumpRangeCaches[sizeClass];
+        while (bumpRangeCache.size())
+            logBumpRange(objectLog, bumpRangeCache.pop(), objectSize(sizeClass));
+    }
+}
+
+void CPUCache::forkPrepare()
+{
+    s_mutex.lock();
+    for (size_t cpu = 0; cpu < s_cpuCount; ++cpu)
+        s_caches[cpu].m_mutex.lock();
+}
+
+void CPUCache::forkParent()
+{
+    for (size_t cpu = 0; cpu < s_cpuCount; ++cpu)
+        s_caches[cpu].m_mutex.unlock();
+    s_mutex.unlock();
+}
+
+void CPUCache::scavenge()
+{
+    if (!isEnabled())
+        return;
+
+    Deallocator::ObjectLog objectLog;
+
+    // Visit each CPU we're allowed to run on, and drain its rseq state there.
+    cpu_set_t originalSet;
+    if (!sched_getaffinity(0, sizeof(originalSet), &originalSet)) {
+        for (size_t cpu = 0; cpu < s_cpuCount && cpu < CPU_SETSIZE; ++cpu) {
+            if (!CPU_ISSET(cpu, &originalSet))
+                continue;
+
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            if (sched_setaffinity(0, sizeof(set), &set))
+                continue;
+
+            if (rseqCurrentCPU() == static_cast<int>(cpu))
+                s_caches[cpu].scavenge(cpu, objectLog);
+        }
+        sched_setaffinity(0, sizeof(originalSet), &originalSet);
+    }
+
+    for (size_t cpu = 0; cpu < s_cpuCount; ++cpu)
+        s_caches[cpu].scavengeBumpRangeCaches(objectLog);
+
+    Deallocator::processObjectLog(objectLog, nullptr);
+}
+
+} // namespace bmalloc
+
+#endif // HAVE_RSEQ
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#ifndef CPUCache_h
+#define CPUCache_h
+
+#include "BumpRange.h"
+#include "Deallocator.h"
+#include "Inline.h"
+#include "Rseq.h"
+#include "Sizes.h"
+#include "StaticMutex.h"
+#include <array>
+#include <atomic>
+
+#if HAVE_RSEQ
+
+namespace bmalloc {
+
+class Heap;
+
+// Optional per-CPU allocation / deallocation cache for small and medium
+// objects, backed by a Heap shard. Its fast paths are restartable sequences,
+// so the memory held in caches scales with CPUs rather than with threads.
+// Anything else -- and any thread without an rseq registration -- falls back
+// to PerThread<Cache>.
+
+class CPUCache {
+public:
+    static bool isEnabled() { return s_isEnabled.load(std::memory_order_acquire); }
+    static bool initialize();
+
+    static void* allocate(size_t);
+    static void deallocate(void*);
+
+    // Returns every object held by every CPU's cache to the heap.
+    static void scavenge();
+
+    // fork() support. forkPrepare takes our global lock and every CPU's lock,
+    // and forkParent and forkChild release them.
+    static void forkPrepare();
+    static void forkParent();
+    static void forkChild() { forkParent(); }
+
+    CPUCache(Heap*);
+
+private:
+    static void* allocateSlowCase(size_t sizeClass);
+    static void deallocateSlowCase(void*);
+
+    void* refillAndAllocate(int cpu, size_t sizeClass);
+    void processObjectLog(int cpu);
+    void scavenge(int cpu, Deallocator::ObjectLog&);
+    void scavengeBumpRangeCaches(Deallocator::ObjectLog&);
+
+    // Only touched inside rseq critical sections on this CPU.
+    std::array<uint64_t, mediumMax / alignment> m_bumpWords __attribute__((aligned(64)));
+    uint64_t m_objectLogSize;
+    std::array<void*, deallocatorLogCapacity> m_objectLog;
+
+    // Protects m_bumpRangeCaches, which may be touched from any CPU.
+    StaticMutex m_mutex;
+    std::array<BumpRangeCache, mediumMax / alignment> m_bumpRangeCaches;
+
+    Heap* m_heap;
+
+    static std::atomic<bool> s_isEnabled;
+    static bool s_isInitialized;
+    static StaticMutex s_mutex;
+    static CPUCache* s_caches;
+    static size_t s_cpuCount;
+};
+
+INLINE void* CPUCache::allocate(size_t size)
+{
+    BASSERT(size <= mediumMax);
+    size_t sizeClass = bmalloc::sizeClass(size);
+    int cpu = rseqCurrentCPU();
+    if (static_cast<size_t>(cpu) < s_cpuCount) {
+        void* object;
+        if (rseqBumpAllocate(cpu, &s_caches[cpu].m_bumpWords[sizeClass], objectSize(sizeClass), object) == RseqResult::Committed)
+            return object;
+    }
+    return allocateSlowCase(sizeClass);
+}
+
+INLINE void CPUCache::deallocate(void* object)
+{
+    BASSERT(isSmallOrMedium(object));
+    int cpu = rseqCurrentCPU();
+    if (static_cast<size_t>(cpu) < s_cpuCount) {
+        CPUCache& cache = s_caches[cpu];
+        if (rseqPush(cpu, &cache.m_objectLogSize, cache.m_objectLog.data(), deallocatorLogCapacity, object) == RseqResult::Committed)
+            return;
+    }
+    deallocateSlowCase(object);
+}
+
+} // namespace bmalloc
+
+#endif // HAVE_RSEQ
+
+#endif // CPUCache_h
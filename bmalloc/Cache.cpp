@@ -26,7 +26,8 @@
 #include "Cache.h"
 #include "Heap.h"
 #include "Inline.h"
-#include "PerProcess.h"
+#include "PerShard.h"
+#include <atomic>
 
 namespace bmalloc {
 
@@ -50,35 +51,109 @@ void Cache::scavenge()
     cache->deallocator().scavenge();
 }
 
+// Threads are bound to shards round-robin, for the lifetime of their cache.
+static size_t nextShard()
+{
+    static std::atomic<size_t> s_nextShard;
+    return s_nextShard.fetch_add(1, std::memory_order_relaxed) % heapShardCount;
+}
+
 Cache::Cache()
-    : m_deallocator(PerProcess<Heap>::get())
-    , m_allocator(PerProcess<Heap>::get(), m_deallocator)
+    : m_deallocator(PerShard<Heap>::get(nextShard()))
+    , m_allocator(m_deallocator.heap(), m_deallocator)
 {
 }
 
 NO_INLINE void* Cache::tryAllocateSlowCaseNullCache(size_t size)
 {
+#if HAVE_RSEQ
+    if (CPUCache::initialize() && size <= mediumMax)
+        return CPUCache::allocate(size);
+#endif
     return PerThread<Cache>::getSlowCase()->allocator().tryAllocate(size);
 }
 
 NO_INLINE void* Cache::allocateSlowCaseNullCache(size_t size)
 {
+#if HAVE_RSEQ
+    if (CPUCache::initialize() && size <= mediumMax)
+        return CPUCache::allocate(size);
+#endif
     return PerThread<Cache>::getSlowCase()->allocator().allocate(size);
 }
 
+NO_INLINE void* Cache::tryAllocateSlowCaseNullCache(size_t alignment, size_t size)
+{
+    return PerThread<Cache>::getSlowCase()->allocator().tryAllocate(alignment, size);
+}
+
 NO_INLINE void* Cache::allocateSlowCaseNullCache(size_t alignment, size_t size)
 {
     return PerThread<Cache>::getSlowCase()->allocator().allocate(alignment, size);
 }
 
+NO_INLINE void* Cache::allocateZeroedSlowCaseNullCache(size_t size)
+{
+#if HAVE_RSEQ
+    if (CPUCache::initialize() && size <= mediumMax) {
+        void* result = CPUCache::allocate(size);
+        memset(result, 0, size);
+        return result;
+    }
+#endif
+    return PerThread<Cache>::getSlowCase()->allocator().allocateZeroed(size);
+}
+
+NO_INLINE size_t Cache::usableSizeSlowCaseNullCache(void* object)
+{
+    return PerThread<Cache>::getSlowCase()->allocator().usableSize(object);
+}
+
 NO_INLINE void Cache::deallocateSlowCaseNullCache(void* object)
 {
+#if HAVE_RSEQ
+    if (CPUCache::initialize() && isSmallOrMedium(object))
+        return CPUCache::deallocate(object);
+#endif
     PerThread<Cache>::getSlowCase()->deallocator().deallocate(object);
 }
 
+NO_INLINE void Cache::deallocateSlowCaseNullCache(void* object, size_t size)
+{
+#if HAVE_RSEQ
+    if (CPUCache::initialize() && size <= mediumLargeMax && object)
+        return CPUCache::deallocate(object);
+#endif
+    PerThread<Cache>::getSlowCase()->deallocator().deallocate(object, size);
+}
+
 NO_INLINE void* Cache::reallocateSlowCaseNullCache(void* object, size_t newSize)
 {
     return PerThread<Cache>::getSlowCase()->allocator().reallocate(object, newSize);
 }
 
+NO_INLINE void Cache::batchAllocateSlowCaseNullCache(size_t size, size_t count, void** objects)
+{
+#if HAVE_RSEQ
+    if (CPUCache::initialize() && size <= mediumMax) {
+        for (size_t i = 0; i < count; ++i)
+            objects[i] = CPUCache::allocate(size);
+        return;
+    }
+#endif
+    PerThread<Cache>::getSlowCase()->allocator().batchAllocate(size, count, objects);
+}
+
+NO_INLINE void Cache::batchDeallocateSlowCaseNullCache(void** objects, size_t count)
+{
+#if HAVE_RSEQ
+    if (CPUCache::initialize()) {
+        for (size_t i = 0; i < count; ++i)
+            deallocate(objects[i]);
+        return;
+    }
+#endif
+    PerThread<Cache>::getSlowCase()->deallocator().batchDeallocate(objects, count);
+}
+
 } // namespace bmalloc
@@ -27,12 +27,15 @@
 #define Cache_h
 
 #include "Allocator.h"
+#include "CPUCache.h"
 #include "Deallocator.h"
 #include "PerThread.h"
+#include <cstring>
 
 namespace bmalloc {
 
-// Per-thread allocation / deallocation cache, backed by a per-process Heap.
+// Per-thread allocation / deallocation cache, backed by a Heap shard. When
+// CPUCache is enabled, small and medium objects bypass it.
 
 class Cache {
 public:
@@ -41,9 +44,15 @@ public:
 
     static void* tryAllocate(size_t);
     static void* allocate(size_t);
+    static void* tryAllocate(size_t alignment, size_t);
     static void* allocate(size_t alignment, size_t);
+    static void* allocateZeroed(size_t);
+    static size_t usableSize(void*);
     static void deallocate(void*);
+    static void deallocate(void*, size_t);
     static void* reallocate(void*, size_t);
+    static void batchAllocate(size_t, size_t count, void** objects);
+    static void batchDeallocate(void** objects, size_t count);
 
     static void scavenge();
 
@@ -55,9 +64,15 @@ public:
 private:
     static void* tryAllocateSlowCaseNullCache(size_t);
     static void* allocateSlowCaseNullCache(size_t);
+    static void* tryAllocateSlowCaseNullCache(size_t alignment, size_t);
     static void* allocateSlowCaseNullCache(size_t alignment, size_t);
+    static void* allocateZeroedSlowCaseNullCache(size_t);
+    static size_t usableSizeSlowCaseNullCache(void*);
     static void deallocateSlowCaseNullCache(void*);
+    static void deallocateSlowCaseNullCache(void*, size_t);
     static void* reallocateSlowCaseNullCache(void*, size_t);
+    static void batchAllocateSlowCaseNullCache(size_t, size_t count, void** objects);
+    static void batchDeallocateSlowCaseNullCache(void** objects, size_t count);
 
     Deallocator m_deallocator;
     Allocator m_allocator;
@@ -65,6 +80,10 @@ private:
 
 inline void* Cache::tryAllocate(size_t size)
 {
+#if HAVE_RSEQ
+    if (CPUCache::isEnabled() && size <= mediumMax)
+        return CPUCache::allocate(size);
+#endif
     Cache* cache = PerThread<Cache>::getFastCase();
     if (!cache)
         return tryAllocateSlowCaseNullCache(size);
@@ -73,28 +92,93 @@ inline void* Cache::tryAllocate(size_t size)
 
 inline void* Cache::allocate(size_t size)
 {
+#if HAVE_RSEQ
+    if (CPUCache::isEnabled() && size <= mediumMax)
+        return CPUCache::allocate(size);
+#endif
     Cache* cache = PerThread<Cache>::getFastCase();
     if (!cache)
         return allocateSlowCaseNullCache(size);
     return cache->allocator().allocate(size);
 }
 
+inline void* Cache::tryAllocate(size_t alignment, size_t size)
+{
+#if HAVE_RSEQ
+    if (CPUCache::isEnabled() && size <= mediumMax && alignment <= vmPageSize) {
+        size_t alignedSize = alignedObjectSize(alignment, size);
+        if (alignedSize <= mediumMax)
+            return CPUCache::allocate(alignedSize);
+    }
+#endif
+    Cache* cache = PerThread<Cache>::getFastCase();
+    if (!cache)
+        return tryAllocateSlowCaseNullCache(alignment, size);
+    return cache->allocator().tryAllocate(alignment, size);
+}
+
 inline void* Cache::allocate(size_t alignment, size_t size)
 {
+#if HAVE_RSEQ
+    if (CPUCache::isEnabled() && size <= mediumMax && alignment <= vmPageSize) {
+        size_t alignedSize = alignedObjectSize(alignment, size);
+        if (alignedSize <= mediumMax)
+            return CPUCache::allocate(alignedSize);
+    }
+#endif
     Cache* cache = PerThread<Cache>::getFastCase();
     if (!cache)
         return allocateSlowCaseNullCache(alignment, size);
     return cache->allocator().allocate(alignment, size);
 }
 
+inline void* Cache::allocateZeroed(size_t size)
+{
+#if HAVE_RSEQ
+    if (CPUCache::isEnabled() && size <= mediumMax) {
+        void* result = CPUCache::allocate(size);
+        memset(result, 0, size);
+        return result;
+    }
+#endif
+    Cache* cache = PerThread<Cache>::getFastCase();
+    if (!cache)
+        return allocateZeroedSlowCaseNullCache(size);
+    return cache->allocator().allocateZeroed(size);
+}
+
+inline size_t Cache::usableSize(void* object)
+{
+    Cache* cache = PerThread<Cache>::getFastCase();
+    if (!cache)
+        return usableSizeSlowCaseNullCache(object);
+    return cache->allocator().usableSize(object);
+}
+
 inline void Cache::deallocate(void* object)
 {
+#if HAVE_RSEQ
+    if (CPUCache::isEnabled() && isSmallOrMedium(object))
+        return CPUCache::deallocate(object);
+#endif
     Cache* cache = PerThread<Cache>::getFastCase();
     if (!cache)
         return deallocateSlowCaseNullCache(object);
     return cache->deallocator().deallocate(object);
 }
 
+inline void Cache::deallocate(void* object, size_t size)
+{
+#if HAVE_RSEQ
+    if (CPUCache::isEnabled() && size <= mediumLargeMax && object)
+        return CPUCache::deallocate(object);
+#endif
+    Cache* cache = PerThread<Cache>::getFastCase();
+    if (!cache)
+        return deallocateSlowCaseNullCache(object, size);
+    return cache->deallocator().deallocate(object, size);
+}
+
 inline void* Cache::reallocate(void* object, size_t newSize)
 {
     Cache* cache = PerThread<Cache>::getFastCase();
@@ -103,6 +187,36 @@ inline void* Cache::reallocate(void* object, size_t newSize)
     return cache->allocator().reallocate(object, newSize);
 }
 
+inline void Cache::batchAllocate(size_t size, size_t count, void** objects)
+{
+#if HAVE_RSEQ
+    if (CPUCache::isEnabled() && size <= mediumMax) {
+        for (size_t i = 0; i < count; ++i)
+            objects[i] = CPUCache::allocate(size);
+        return;
+    }
+#endif
+    Cache* cache = PerThread<Cache>::getFastCase();
+    if (!cache)
+        return batchAllocateSlowCaseNullCache(size, count, objects);
+    cache->allocator().batchAllocate(size, count, objects);
+}
+
+inline void Cache::batchDeallocate(void** objects, size_t count)
+{
+#if HAVE_RSEQ
+    if (CPUCache::isEnabled()) {
+        for (size_t i = 0; i < count; ++i)
+            deallocate(objects[i]);
+        return;
+    }
+#endif
+    Cache* cache = PerThread<Cache>::getFastCase();
+    if (!cache)
+        return batchDeallocateSlowCaseNullCache(objects, count);
+    cache->deallocator().batchDeallocate(objects, count);
+}
+
 } // namespace bmalloc
 
 #endif // Cache_h
@@ -26,6 +26,7 @@
 #ifndef Chunk_h
 #define Chunk_h
 
+#include "HugePage.h"
 #include "ObjectType.h"
 #include "Sizes.h"
 #include "VMAllocate.h"
@@ -39,27 +40,49 @@ public:
     typedef typename Traits::LineType Line;
 
     static const size_t lineSize = Traits::lineSize;
+    static const size_t pageSize = Traits::pageSize;
     static const size_t chunkSize = Traits::chunkSize;
     static const size_t chunkOffset = Traits::chunkOffset;
     static const uintptr_t chunkMask = Traits::chunkMask;
 
     static Chunk* get(void*);
 
-    Page* begin() { return Page::get(Line::get(m_memory)); }
+    Chunk(size_t shard, bool isHugeTLB);
+
+    size_t shard() { return m_shard; }
+
+    // Whether we mapped the chunk from the HugeTLBPool.
+    bool isHugeTLB() { return m_isHugeTLB; }
+
+    Page* begin();
     Page* end() { return &m_pages[pageCount]; }
     
     Line* lines() { return m_lines; }
     Page* pages() { return m_pages; }
 
+    static const size_t pagesPerHugePage = hugePageSize / pageSize;
+    static const size_t hugePageCount = chunkSize / hugePageSize;
+
+    HugePage* hugePages() { return m_hugePages; }
+    HugePage* hugePage(Page* page) { return &m_hugePages[(page - m_pages) / pagesPerHugePage]; }
+    Page* firstPage(HugePage* hugePage) { return &m_pages[(hugePage - m_hugePages) * pagesPerHugePage]; }
+
 private:
-    static_assert(!(vmPageSize % lineSize), "vmPageSize must be an even multiple of line size");
-    static_assert(!(chunkSize % lineSize), "chunk size must be an even multiple of line size");
+    static_assert(!(pageSize % vmPageSize), "page size must be an even multiple of vmPageSize");
+    static_assert(!(pageSize % lineSize), "page size must be an even multiple of line size");
+    static_assert(!(chunkSize % pageSize), "chunk size must be an even multiple of page size");
+    static_assert(!(hugePageSize % pageSize), "huge page size must be an even multiple of page size");
+    static_assert(!(chunkSize % hugePageSize), "chunk size must be an even multiple of huge page size");
+    static_assert(pagesPerHugePage <= HugePage::maxPageCount, "HugePage must fit a huge page's pages");
 
     static const size_t lineCount = chunkSize / lineSize;
-    static const size_t pageCount = chunkSize / vmPageSize;
+    static const size_t pageCount = chunkSize / pageSize;
 
     Line m_lines[lineCount];
     Page m_pages[pageCount];
+    HugePage m_hugePages[hugePageCount];
+    unsigned m_shard;
+    bool m_isHugeTLB;
 
     // Align to vmPageSize to avoid sharing physical pages with metadata.
     // Otherwise, we'll confuse the scavenger into trying to scavenge metadata.
@@ -74,6 +97,21 @@ private:
 #endif
 };
 
+template<class Traits>
+inline Chunk<Traits>::Chunk(size_t shard, bool isHugeTLB)
+    : m_shard(shard)
+    , m_isHugeTLB(isHugeTLB)
+{
+}
+
+template<class Traits>
+inline auto Chunk<Traits>::begin() -> Page*
+{
+    // The first page that doesn't overlap our metadata.
+    size_t metadataSize = m_memory - reinterpret_cast<char*>(this);
+    return &m_pages[roundUpToMultipleOf<pageSize>(metadataSize) / pageSize];
+}
+
 template<class Traits>
 inline auto Chunk<Traits>::get(void* object) -> Chunk*
 {
@@ -28,9 +28,10 @@
 #include "Deallocator.h"
 #include "Heap.h"
 #include "Inline.h"
-#include "PerProcess.h"
+#include "PerShard.h"
 #include "SmallChunk.h"
 #include <algorithm>
+#include <array>
 #include <cstdlib>
 #include <sys/mman.h>
 
@@ -39,7 +40,8 @@ using namespace std;
 namespace bmalloc {
 
 Deallocator::Deallocator(Heap* heap)
-    : m_isBmallocEnabled(heap->environment().isBmallocEnabled())
+    : m_heap(heap)
+    , m_isBmallocEnabled(heap->environment().isBmallocEnabled())
 {
     if (!m_isBmallocEnabled) {
         // Fill the object log in order to disable the fast path.
@@ -61,33 +63,183 @@ void Deallocator::scavenge()
 
 void Deallocator::deallocateLarge(void* object)
 {
-    std::lock_guard<StaticMutex> lock(PerProcess<Heap>::mutex());
-    PerProcess<Heap>::getFastCase()->deallocateLarge(lock, object);
+    Heap* heap = PerShard<Heap>::getFastCase(Heap::shard(object));
+    std::lock_guard<StaticMutex> lock(heap->largeMutex());
+    heap->deallocateLarge(lock, object);
 }
 
 void Deallocator::deallocateXLarge(void* object)
 {
-    std::unique_lock<StaticMutex> lock(PerProcess<Heap>::mutex());
-    PerProcess<Heap>::getFastCase()->deallocateXLarge(lock, object);
+    Heap* heap = PerShard<Heap>::getFastCase(Heap::shard(object));
+    std::unique_lock<StaticMutex> lock(heap->xLargeMutex());
+    heap->deallocateXLarge(lock, object);
+}
+
+// Identifies the size class of a small, medium or medium-large object.
+static size_t sizeClassOf(void* object)
+{
+    if (isSmall(object))
+        return SmallPage::get(SmallLine::get(object))->sizeClass();
+    if (isMediumLarge(object))
+        return MediumLargePage::get(MediumLargeLine::get(object))->sizeClass();
+    return MediumPage::get(MediumLine::get(object))->sizeClass();
+}
+
+static void derefBatch(Heap* heap, BumpRangeCache& batch)
+{
+    for (auto& bumpRange : batch)
+        heap->derefLine(bumpRange.begin);
+    batch.clear();
+}
+
+void Deallocator::processObjectLog(ObjectLog& objectLog, Heap* localHeap)
+{
+    // We chain remote objects by shard, so each owner gets a single push.
+    std::array<void*, heapShardCount> heads;
+    std::array<void*, heapShardCount> tails;
+    heads.fill(nullptr);
+
+    // Local objects become one-object ranges that keep their line references.
+    // A full batch of one size class goes to the transfer cache, so a refill
+    // can take it without scanning a page. We free the rest.
+    BumpRangeCache batch;
+    size_t batchSizeClass = 0;
+
+    // A page holds one size class, so sorting by address groups each size
+    // class's objects, even when frees of different sizes interleave.
+    if (localHeap)
+        std::sort(objectLog.begin(), objectLog.end());
+
+    for (auto* object : objectLog) {
+        size_t shard = Heap::shard(object);
+        if (!localHeap) {
+            PerShard<Heap>::getFastCase(shard)->derefLine(object);
+            continue;
+        }
+
+        if (shard == localHeap->shard()) {
+            size_t sizeClass = sizeClassOf(object);
+            if (sizeClass != batchSizeClass) {
+                derefBatch(localHeap, batch);
+                batchSizeClass = sizeClass;
+            }
+
+            batch.push({ static_cast<char*>(object), 1 });
+            if (batch.size() == batch.capacity() && !localHeap->transferCache(sizeClass).tryPush(batch))
+                derefBatch(localHeap, batch);
+            continue;
+        }
+
+        if (!heads[shard])
+            tails[shard] = object;
+        *static_cast<void**>(object) = heads[shard];
+        heads[shard] = object;
+    }
+
+    for (size_t shard = 0; shard < heapShardCount; ++shard) {
+        if (!heads[shard])
+            continue;
+        PerShard<Heap>::getFastCase(shard)->pushRemoteFrees(heads[shard], tails[shard]);
+    }
+
+    if (localHeap)
+        derefBatch(localHeap, batch);
+    objectLog.clear();
 }
 
 void Deallocator::processObjectLog()
 {
-    std::lock_guard<StaticMutex> lock(PerProcess<Heap>::mutex());
-    Heap* heap = PerProcess<Heap>::getFastCase();
-    
-    for (auto object : m_objectLog) {
-        if (isSmall(object)) {
-            SmallLine* line = SmallLine::get(object);
-            heap->derefSmallLine(lock, line);
+    processObjectLog(m_objectLog, m_heap);
+}
+
+// Identifies the line of a small, medium or medium-large object.
+static void* lineOf(void* object)
+{
+    if (isSmall(object))
+        return SmallLine::get(object);
+    if (isMediumLarge(object))
+        return MediumLargeLine::get(object);
+    return MediumLine::get(object);
+}
+
+void Deallocator::batchDeallocate(void** objects, size_t count)
+{
+    if (!m_isBmallocEnabled) {
+        for (size_t i = 0; i < count; ++i)
+            free(objects[i]);
+        return;
+    }
+
+    // Null sorts first. Batches are often sorted already, for example when
+    // they came from batchMalloc.
+    if (!std::is_sorted(objects, objects + count))
+        std::sort(objects, objects + count);
+    size_t i = 0;
+    while (i < count && !objects[i])
+        ++i;
+
+    std::array<void*, heapShardCount> heads;
+    std::array<void*, heapShardCount> tails;
+    heads.fill(nullptr);
+
+    while (i < count) {
+        void* object = objects[i];
+        size_t shard = Heap::shard(object);
+        ObjectType type = objectType(object);
+
+        size_t end = i + 1;
+        if (isSmallOrMedium(object)) {
+            // A line holds fewer than 256 objects, so a run fits in its
+            // reference count.
+            void* line = lineOf(object);
+            while (end < count && isSmallOrMedium(objects[end]) && lineOf(objects[end]) == line)
+                ++end;
         } else {
-            BASSERT(isMedium(object));
-            MediumLine* line = MediumLine::get(object);
-            heap->derefMediumLine(lock, line);
+            while (end < count && objectType(objects[end]) == type && Heap::shard(objects[end]) == shard)
+                ++end;
+        }
+
+        switch (type) {
+        case Small:
+        case Medium:
+        case MediumLarge: {
+            if (shard == m_heap->shard()) {
+                m_heap->derefLine(object, static_cast<unsigned char>(end - i));
+                break;
+            }
+
+            for (size_t j = i; j < end; ++j) {
+                if (!heads[shard])
+                    tails[shard] = objects[j];
+                *static_cast<void**>(objects[j]) = heads[shard];
+                heads[shard] = objects[j];
+            }
+            break;
         }
+        case Large: {
+            Heap* heap = PerShard<Heap>::getFastCase(shard);
+            std::lock_guard<StaticMutex> lock(heap->largeMutex());
+            for (size_t j = i; j < end; ++j)
+                heap->deallocateLarge(lock, objects[j]);
+            break;
+        }
+        case XLarge: {
+            Heap* heap = PerShard<Heap>::getFastCase(shard);
+            std::unique_lock<StaticMutex> lock(heap->xLargeMutex());
+            for (size_t j = i; j < end; ++j)
+                heap->deallocateXLarge(lock, objects[j]);
+            break;
+        }
+        }
+
+        i = end;
+    }
+
+    for (size_t shard = 0; shard < heapShardCount; ++shard) {
+        if (!heads[shard])
+            continue;
+        PerShard<Heap>::getFastCase(shard)->pushRemoteFrees(heads[shard], tails[shard]);
     }
-    
-    m_objectLog.clear();
 }
 
 void Deallocator::deallocateSlowCase(void* object)
@@ -115,4 +267,58 @@ void Deallocator::deallocateSlowCase(void* object)
     return deallocateXLarge(object);
 }
 
+void Deallocator::deallocateSlowCase(void* object, size_t size)
+{
+    if (!m_isBmallocEnabled) {
+        free(object);
+        return;
+    }
+
+    if (!object)
+        return;
+
+    if (size <= mediumLargeMax) {
+        processObjectLog();
+        m_objectLog.push(object);
+        return;
+    }
+
+    if (size <= largeMax)
+        return deallocateLarge(object);
+
+    return deallocateXLarge(object);
+}
+
+void Deallocator::validateSize(void* object, size_t size)
+{
+    if (!object || !m_isBmallocEnabled)
+        return;
+
+    // An object's size class is the one its size maps to, unless reallocate
+    // shrank it in place, which leaves it at most twice the new size.
+    if (size <= mediumLargeMax) {
+        ObjectType type = objectType(object);
+        BASSERT(type == Small || type == Medium || type == MediumLarge);
+        UNUSED(type);
+
+        size_t sizeClass = sizeClassOf(object);
+        size_t expectedSizeClass = size <= mediumMax ? bmalloc::sizeClass(size) : mediumLargeSizeClass(size);
+        BASSERT(sizeClass == expectedSizeClass
+            || (size <= objectSize(sizeClass) && size >= objectSize(sizeClass) / 2));
+        UNUSED(sizeClass);
+        UNUSED(expectedSizeClass);
+        return;
+    }
+
+    if (size <= largeMax) {
+        BASSERT(objectType(object) == Large);
+        Heap* heap = PerShard<Heap>::getFastCase(Heap::shard(object));
+        std::lock_guard<StaticMutex> lock(heap->largeMutex());
+        BASSERT(LargeObject(object).size() >= size);
+        return;
+    }
+
+    BASSERT(objectType(object) == XLarge);
+}
+
 } // namespace bmalloc
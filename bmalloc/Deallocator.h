@@ -26,7 +26,10 @@
 #ifndef Deallocator_h
 #define Deallocator_h
 
+#include "BAssert.h"
 #include "FixedVector.h"
+#include "ObjectType.h"
+#include "Sizes.h"
 
 namespace bmalloc {
 
@@ -36,21 +39,42 @@ class Heap;
 
 class Deallocator {
 public:
+    typedef FixedVector<void*, deallocatorLogCapacity> ObjectLog;
+
+    // Returns a batch of small and medium objects, from any shards, to their
+    // heaps, and clears the log. Objects owned by shards other than the
+    // given local heap go to their owners' remote free lists. A null local
+    // heap returns every object directly.
+    static void processObjectLog(ObjectLog&, Heap* localHeap);
+
     Deallocator(Heap*);
     ~Deallocator();
 
+    Heap* heap() { return m_heap; }
+
     void deallocate(void*);
     void scavenge();
+
+    // Takes the object's type from its allocation size, which must be the
+    // size passed to the allocate or reallocate call that returned it.
+    void deallocate(void*, size_t);
+
+    // Frees count objects. Sorts objects by address, so we can group them
+    // by line and by heap.
+    void batchDeallocate(void** objects, size_t count);
     
 private:
     bool deallocateFastCase(void*);
     void deallocateSlowCase(void*);
+    void deallocateSlowCase(void*, size_t);
+    void validateSize(void*, size_t);
 
     void deallocateLarge(void*);
     void deallocateXLarge(void*);
     void processObjectLog();
 
-    FixedVector<void*, deallocatorLogCapacity> m_objectLog;
+    ObjectLog m_objectLog;
+    Heap* m_heap;
     bool m_isBmallocEnabled;
 };
 
@@ -74,6 +98,18 @@ inline void Deallocator::deallocate(void* object)
         deallocateSlowCase(object);
 }
 
+inline void Deallocator::deallocate(void* object, size_t size)
+{
+    IF_DEBUG(validateSize(object, size));
+
+    if (size <= mediumLargeMax && object && m_objectLog.size() != m_objectLog.capacity()) {
+        m_objectLog.push(object);
+        return;
+    }
+
+    deallocateSlowCase(object, size);
+}
+
 } // namespace bmalloc
 
 #endif // Deallocator_h
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#ifndef Decay_h
+#define Decay_h
+
+#include <algorithm>
+#include <chrono>
+
+// The scavenger returns free memory to the OS gradually. Memory that was
+// freed age ago stays warm with weight decayWeight(age), which falls along a
+// smoothstep curve from 1, when freed, to 0, after decayTime. So memory freed
+// by a burst mostly stays resident for the next burst, and memory that stays
+// free is released over decayTime rather than all at once.
+
+namespace bmalloc {
+
+// A millisecond clock that's cheap to store. Wraps after about 49 days, so
+// only compare nearby times, via decayAge.
+inline unsigned decayClock()
+{
+    return static_cast<unsigned>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+inline std::chrono::milliseconds decayAge(unsigned now, unsigned then)
+{
+    return std::chrono::milliseconds(now - then);
+}
+
+inline double decayWeight(std::chrono::milliseconds age, std::chrono::milliseconds decayTime)
+{
+    if (age >= decayTime)
+        return 0;
+
+    double x = static_cast<double>(age.count()) / decayTime.count();
+    return 1 - x * x * (3 - 2 * x);
+}
+
+// Free lists that we keep in the order we freed them hold their oldest pages
+// first, so we can weigh them without visiting every page: we binary search for
+// the pages in each of decayBucketCount age ranges and give them all the weight
+// at the middle of their range. That's off by at most 0.75 / decayBucketCount
+// per page.
+static const size_t decayBucketCount = 32;
+
+template<typename Page>
+double decayWeight(Page** begin, Page** end, unsigned now, std::chrono::milliseconds decayTime)
+{
+    double weight = 0;
+    for (size_t bucket = 0; bucket < decayBucketCount; ++bucket) {
+        std::chrono::milliseconds maxAge = decayTime * (bucket + 1) / decayBucketCount;
+        Page** bucketBegin = std::partition_point(begin, end, [&](Page* page) {
+            return decayAge(now, page->freeTime()) >= maxAge;
+        });
+
+        std::chrono::milliseconds age = decayTime * (2 * bucket + 1) / (2 * decayBucketCount);
+        weight += (end - bucketBegin) * decayWeight(age, decayTime);
+        end = bucketBegin;
+    }
+    return weight;
+}
+
+} // namespace bmalloc
+
+#endif // Decay_h
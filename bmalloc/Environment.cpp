@@ -25,6 +25,7 @@
 
 #include "BPlatform.h"
 #include "Environment.h"
+#include "Sizes.h"
 #include <cstdlib>
 #include <cstring>
 #if BOS(DARWIN)
@@ -89,11 +90,21 @@ static bool isASanEnabled()
 
 Environment::Environment()
     : m_isBmallocEnabled(computeIsBmallocEnabled())
+    , m_isPerCPUCacheEnabled(computeIsPerCPUCacheEnabled())
+    , m_isHugePageModeEnabled(computeIsHugePageModeEnabled())
+    , m_scavengerDecayTime(computeScavengerDecayTime())
+    , m_scavengerRSSTarget(computeScavengerRSSTarget())
+    , m_hugeTLBPoolSize(computeHugeTLBPoolSize())
+    , m_hugeTLBPageSize(computeHugeTLBPageSize())
 {
 }
 
 bool Environment::computeIsBmallocEnabled()
 {
+#if BMALLOC_REPLACES_SYSTEM_MALLOC
+    // We are the system malloc, so there's nothing to fall back to.
+    return true;
+#endif
     if (isMallocEnvironmentVariableSet())
         return false;
     if (isLibgmallocEnabled())
@@ -103,4 +114,64 @@ bool Environment::computeIsBmallocEnabled()
     return true;
 }
 
+bool Environment::computeIsPerCPUCacheEnabled()
+{
+    if (!m_isBmallocEnabled)
+        return false;
+
+    char* variable = getenv("BMALLOC_PER_CPU_CACHE");
+    if (!variable)
+        return false;
+    if (!strcmp(variable, "0"))
+        return false;
+    return true;
+}
+
+bool Environment::computeIsHugePageModeEnabled()
+{
+    char* variable = getenv("BMALLOC_HUGE_PAGES");
+    if (!variable)
+        return false;
+    if (!strcmp(variable, "0"))
+        return false;
+    return true;
+}
+
+std::chrono::milliseconds Environment::computeScavengerDecayTime()
+{
+    char* variable = getenv("BMALLOC_SCAVENGER_DECAY_MS");
+    if (!variable)
+        return scavengeDecayTime;
+    return std::chrono::milliseconds(strtoul(variable, nullptr, 10));
+}
+
+size_t Environment::computeScavengerRSSTarget()
+{
+    char* variable = getenv("BMALLOC_SCAVENGER_RSS_TARGET");
+    if (!variable)
+        return 0;
+    return strtoull(variable, nullptr, 10);
+}
+
+size_t Environment::computeHugeTLBPoolSize()
+{
+    char* variable = getenv("BMALLOC_HUGETLB_POOL_SIZE");
+    if (!variable)
+        return 0;
+    return strtoull(variable, nullptr, 10);
+}
+
+size_t Environment::computeHugeTLBPageSize()
+{
+    char* variable = getenv("BMALLOC_HUGETLB_PAGE_SIZE");
+    if (!variable)
+        return hugePageSize;
+
+    // The OS only offers power-of-two huge page sizes, like 2MB and 1GB.
+    size_t pageSize = strtoull(variable, nullptr, 10);
+    if (!isPowerOfTwo(pageSize) || pageSize < vmPageSize)
+        return hugePageSize;
+    return pageSize;
+}
+
 } // namespace bmalloc
@@ -26,6 +26,9 @@
 #ifndef Environment_h
 #define Environment_h
 
+#include <chrono>
+#include <cstddef>
+
 namespace bmalloc {
 
 class Environment {
@@ -33,11 +36,37 @@ public:
     Environment();
     
     bool isBmallocEnabled() { return m_isBmallocEnabled; }
+    bool isPerCPUCacheEnabled() { return m_isPerCPUCacheEnabled; }
+    bool isHugePageModeEnabled() { return m_isHugePageModeEnabled; }
+
+    // How long the scavenger takes to return free memory to the OS.
+    std::chrono::milliseconds scavengerDecayTime() { return m_scavengerDecayTime; }
+
+    // While the process's resident size is at or below this many bytes, the
+    // scavenger keeps free memory warm. Zero means no target.
+    size_t scavengerRSSTarget() { return m_scavengerRSSTarget; }
+
+    // How many bytes of explicitly reserved huge pages (MAP_HUGETLB) we may
+    // map, and the size of those pages. Zero means we never map them.
+    size_t hugeTLBPoolSize() { return m_hugeTLBPoolSize; }
+    size_t hugeTLBPageSize() { return m_hugeTLBPageSize; }
 
 private:
     bool computeIsBmallocEnabled();
+    bool computeIsPerCPUCacheEnabled();
+    bool computeIsHugePageModeEnabled();
+    std::chrono::milliseconds computeScavengerDecayTime();
+    size_t computeScavengerRSSTarget();
+    size_t computeHugeTLBPoolSize();
+    size_t computeHugeTLBPageSize();
 
     bool m_isBmallocEnabled;
+    bool m_isPerCPUCacheEnabled;
+    bool m_isHugePageModeEnabled;
+    std::chrono::milliseconds m_scavengerDecayTime;
+    size_t m_scavengerRSSTarget;
+    size_t m_hugeTLBPoolSize;
+    size_t m_hugeTLBPageSize;
 };
 
 } // namespace bmalloc
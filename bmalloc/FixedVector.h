@@ -44,6 +44,8 @@ public:
 
     FixedVector();
 
+    T* begin() { return m_buffer.begin(); }
+    T* end() { return begin() + size(); }
     const T* begin() const { return m_buffer.begin(); }
     const T* end() const { return begin() + size(); }
 
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#include "BootstrapArena.h"
+#include "CPUCache.h"
+#include "ForkHandlers.h"
+#include "Heap.h"
+#include "HugeTLBPool.h"
+#include "PerProcess.h"
+#include "PerShard.h"
+#include <mutex>
+#include <pthread.h>
+
+namespace bmalloc {
+
+// We take locks in the same order as everyone else: per-CPU caches, then
+// shard construction, then each shard's heap, then the huge TLB pool's
+// construction, which a heap may start while holding its VMHeap lock, then
+// the bootstrap arena, which may be used while holding any of them.
+//
+// The child only releases locks and resets the scavengers. It doesn't touch
+// thread or per-CPU caches, so it doesn't copy pages it shares with the parent
+// until it actually allocates. Caches that belonged to the parent's other
+// threads are unreachable in the child, and their memory stays allocated.
+
+static void forkPrepare()
+{
+#if HAVE_RSEQ
+    CPUCache::forkPrepare();
+#endif
+
+    for (size_t shard = 0; shard < heapShardCount; ++shard)
+        PerShard<Heap>::mutex(shard).lock();
+
+    for (size_t shard = 0; shard < heapShardCount; ++shard) {
+        if (Heap* heap = PerShard<Heap>::getFastCase(shard))
+            heap->forkPrepare();
+    }
+
+    PerProcess<HugeTLBPool>::mutex().lock();
+
+    BootstrapArena::forkPrepare();
+}
+
+static void forkParent()
+{
+    BootstrapArena::forkParent();
+
+    PerProcess<HugeTLBPool>::mutex().unlock();
+
+    for (size_t shard = heapShardCount; shard--; ) {
+        if (Heap* heap = PerShard<Heap>::getFastCase(shard))
+            heap->forkParent();
+    }
+
+    for (size_t shard = heapShardCount; shard--; )
+        PerShard<Heap>::mutex(shard).unlock();
+
+#if HAVE_RSEQ
+    CPUCache::forkParent();
+#endif
+}
+
+static void forkChild()
+{
+    BootstrapArena::forkChild();
+
+    PerProcess<HugeTLBPool>::mutex().unlock();
+
+    for (size_t shard = heapShardCount; shard--; ) {
+        if (Heap* heap = PerShard<Heap>::getFastCase(shard))
+            heap->forkChild();
+    }
+
+    for (size_t shard = heapShardCount; shard--; )
+        PerShard<Heap>::mutex(shard).unlock();
+
+#if HAVE_RSEQ
+    CPUCache::forkChild();
+#endif
+}
+
+void installForkHandlers()
+{
+    static std::once_flag onceFlag;
+    std::call_once(onceFlag, []() {
+        pthread_atfork(&forkPrepare, &forkParent, &forkChild);
+    });
+}
+
+} // namespace bmalloc
@@ -23,24 +23,51 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
  */
 
+#include "FixedVector.h"
+#include "ForkHandlers.h"
 #include "Heap.h"
+#include "HugeTLBPool.h"
 #include "LargeChunk.h"
 #include "LargeObject.h"
 #include "Line.h"
 #include "MediumChunk.h"
+#include "MediumLargeChunk.h"
 #include "Page.h"
 #include "PerProcess.h"
 #include "SmallChunk.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
 #include <thread>
+#include <unistd.h>
+#if BOS(DARWIN)
+#include <mach/mach.h>
+#endif
 
 namespace bmalloc {
 
-Heap::Heap(std::lock_guard<StaticMutex>&)
-    : m_largeObjects(Owner::Heap)
-    , m_isAllocatingPages(false)
+Heap::Heap(std::lock_guard<StaticMutex>&, size_t shard)
+    : m_isAllocatingPages(false)
+    , m_largeObjects(Owner::Heap)
+    , m_isAllocatingLargeObjects(false)
+    , m_largeFreeTime(0)
+    , m_remoteFrees(nullptr)
+    , m_shard(shard)
+    , m_vmHeap(shard, m_environment.isHugePageModeEnabled())
     , m_scavenger(*this, &Heap::concurrentScavenge)
 {
     initializeLineMetadata();
+
+    for (size_t sizeClass = 0; sizeClass < sizeClassCount; ++sizeClass)
+        m_transferCaches[sizeClass].setMutex(m_transferCacheMutexes[sizeClass]);
+
+    installForkHandlers();
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (auto& statistics : m_refillStatistics)
+        statistics = { 0, 0, now };
 }
 
 void Heap::initializeLineMetadata()
@@ -76,52 +103,341 @@ void Heap::initializeLineMetadata()
         unsigned short objectCount = static_cast<unsigned short>((MediumPage::lineSize - startOffset) / size);
         m_mediumLineMetadata[sizeClass(size)][MediumPage::lineCount - 1] = { startOffset, objectCount };
     }
+
+    for (size_t sizeClass = mediumSizeClassCount; sizeClass < sizeClassCount; ++sizeClass) {
+        size_t size = objectSize(sizeClass);
+        auto& lineMetadata = m_mediumLargeLineMetadata[sizeClass - mediumSizeClassCount];
+        size_t startOffset = 0;
+        for (size_t lineNumber = 0; lineNumber < MediumLargePage::lineCount - 1; ++lineNumber) {
+            size_t objectCount;
+            size_t remainder;
+            divideRoundingUp(MediumLargePage::lineSize - startOffset, size, objectCount, remainder);
+            BASSERT(objectCount);
+            lineMetadata[lineNumber] = { static_cast<unsigned short>(startOffset), static_cast<unsigned short>(objectCount) };
+            startOffset = remainder ? size - remainder : 0;
+        }
+
+        // The last line in the page rounds down instead of up because it's not allowed to overlap into its neighbor.
+        size_t objectCount = (MediumLargePage::lineSize - startOffset) / size;
+        lineMetadata[MediumLargePage::lineCount - 1] = { static_cast<unsigned short>(startOffset), static_cast<unsigned short>(objectCount) };
+    }
+}
+
+// Returns std::numeric_limits<size_t>::max() if we can't tell.
+static size_t processResidentSize()
+{
+#if BOS(LINUX)
+    // We're the allocator, so we avoid stdio, which may allocate.
+    int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return std::numeric_limits<size_t>::max();
+
+    char buffer[128];
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0)
+        return std::numeric_limits<size_t>::max();
+    buffer[length] = '\0';
+
+    // The second field is the resident page count.
+    const char* resident = strchr(buffer, ' ');
+    if (!resident)
+        return std::numeric_limits<size_t>::max();
+    return strtoull(resident + 1, nullptr, 10) * sysconf(_SC_PAGESIZE);
+#elif BOS(DARWIN)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+        return std::numeric_limits<size_t>::max();
+    return info.resident_size;
+#else
+    return std::numeric_limits<size_t>::max();
+#endif
 }
 
 void Heap::concurrentScavenge()
 {
-    std::unique_lock<StaticMutex> lock(PerProcess<Heap>::mutex());
-    scavenge(lock, scavengeSleepDuration);
+    processRemoteFrees();
+    scavengeIdleTransferCaches();
+
+    bool hasFreeMemory = decay();
+    std::this_thread::sleep_for(scavengeSleepDuration);
+
+    // A burst of frees wakes us up only once, so we keep going until the
+    // memory it freed has decayed.
+    if (hasFreeMemory)
+        m_scavenger.run();
 }
 
-void Heap::scavenge(std::unique_lock<StaticMutex>& lock, std::chrono::milliseconds sleepDuration)
+bool Heap::decay()
 {
-    waitUntilFalse(lock, sleepDuration, m_isAllocatingPages);
+    // Pages we release stay lazily freed for another decay time, in case we
+    // need them again soon, before we decommit them.
+    std::chrono::milliseconds idleTime = m_environment.scavengerDecayTime();
+
+    size_t budget = std::numeric_limits<size_t>::max();
+    if (size_t rssTarget = m_environment.scavengerRSSTarget()) {
+        // Below the target, free memory is a warm reserve. If we go over it,
+        // the next free will wake us up again.
+        size_t residentSize = processResidentSize();
+        if (residentSize <= rssTarget)
+            return false;
+        budget = residentSize - rssTarget;
+
+        // Lazily freed pages still count toward resident size.
+        idleTime = std::chrono::milliseconds(0);
+    }
+
+    bool hasFreeMemory = false;
+    hasFreeMemory |= decayPages(m_smallPages, budget);
+    hasFreeMemory |= decayPages(m_mediumPages, budget);
+    hasFreeMemory |= decayPages(m_mediumLargePages, budget);
+    hasFreeMemory |= decayLargeObjects(budget);
+    hasFreeMemory |= m_vmHeap.decommitIdlePages(idleTime);
+    return hasFreeMemory;
+}
+
+template<typename Page>
+bool Heap::decayPages(Vector<Page*>& pages, size_t& budget)
+{
+    // In hugepage mode, the VMHeap frees pages without a system call, and
+    // packs them better than we do, so we give them back right away and let
+    // them decay there, as whole huge pages.
+    std::chrono::milliseconds decayTime = m_environment.isHugePageModeEnabled()
+        ? std::chrono::milliseconds(0) : m_environment.scavengerDecayTime();
+
+    std::unique_lock<StaticMutex> lock(m_pagesMutex);
+    waitUntilFalse(lock, scavengeSleepDuration, m_isAllocatingPages);
+
+    // We keep as many pages as their total weight, and since pages are in the
+    // order they were freed, we release the oldest ones.
+    double warmPageCount = decayWeight(pages.begin(), pages.end(), decayClock(), decayTime);
+    size_t decayedCount = pages.size() - min(pages.size(), static_cast<size_t>(std::ceil(warmPageCount)));
+    decayedCount = min(decayedCount, budget / Page::pageSize);
+    budget -= decayedCount * Page::pageSize;
+
+    // We take all the decayed pages out at once, since removing them from the
+    // front of the list moves the rest.
+    Vector<Page*> decayed;
+    decayed.push(pages.begin(), pages.begin() + decayedCount);
+    pages.shift(decayedCount);
+    bool hasFreePages = pages.size();
+    lock.unlock();
 
-    scavengeSmallPages(lock, sleepDuration);
-    scavengeMediumPages(lock, sleepDuration);
-    scavengeLargeObjects(lock, sleepDuration);
+    for (size_t i = 0; i < decayed.size(); i += scavengeBatchSize)
+        m_vmHeap.deallocatePages(decayed.begin() + i, min(decayed.size() - i, scavengeBatchSize));
 
-    sleep(lock, sleepDuration);
+    return hasFreePages;
 }
 
-void Heap::scavengeSmallPages(std::unique_lock<StaticMutex>& lock, std::chrono::milliseconds sleepDuration)
+bool Heap::decayLargeObjects(size_t& budget)
 {
-    while (m_smallPages.size()) {
-        m_vmHeap.deallocateSmallPage(lock, m_smallPages.pop());
-        waitUntilFalse(lock, sleepDuration, m_isAllocatingPages);
+    std::chrono::milliseconds decayTime = m_environment.scavengerDecayTime();
+
+    std::unique_lock<StaticMutex> lock(m_largeMutex);
+    waitUntilFalse(lock, scavengeSleepDuration, m_isAllocatingLargeObjects);
+
+    // Boundary tags have no room for a free time, so free large objects decay
+    // as a group, starting over whenever we free one.
+    while (budget) {
+        if (decayWeight(decayAge(decayClock(), m_largeFreeTime), decayTime))
+            return true;
+
+        LargeObject largeObject = m_largeObjects.takeGreedy();
+        if (!largeObject)
+            return false;
+
+        budget -= min(budget, largeObject.size());
+        m_vmHeap.deallocateLargeObject(lock, largeObject);
+        waitUntilFalse(lock, scavengeSleepDuration, m_isAllocatingLargeObjects);
+    }
+
+    return true;
+}
+
+void Heap::scavenge(std::chrono::milliseconds sleepDuration)
+{
+    processRemoteFrees();
+    scavengeTransferCaches();
+
+    scavengePages(m_smallPages, sleepDuration);
+    scavengePages(m_mediumPages, sleepDuration);
+    scavengePages(m_mediumLargePages, sleepDuration);
+    scavengeLargeObjects(sleepDuration);
+    m_vmHeap.decommitIdlePages(std::chrono::milliseconds(0));
+
+    if (sleepDuration != std::chrono::milliseconds(0))
+        std::this_thread::sleep_for(sleepDuration);
+}
+
+void Heap::forkPrepare()
+{
+    // Transfer cache locks are innermost.
+    for (auto& mutex : m_smallMutexes)
+        mutex.lock();
+    for (auto& mutex : m_mediumMutexes)
+        mutex.lock();
+    for (auto& mutex : m_mediumLargeMutexes)
+        mutex.lock();
+    m_pagesMutex.lock();
+    m_largeMutex.lock();
+    m_xLargeMutex.lock();
+    m_vmHeap.mutex().lock();
+    for (auto& mutex : m_transferCacheMutexes)
+        mutex.lock();
+    m_scavenger.forkPrepare();
+}
+
+void Heap::forkParent()
+{
+    m_scavenger.forkParent();
+    unlockAfterFork();
+}
+
+void Heap::forkChild()
+{
+    m_scavenger.forkChild();
+    unlockAfterFork();
+}
+
+void Heap::unlockAfterFork()
+{
+    // A StaticMutex has no owner, so a forked child can release the locks its
+    // parent took. If other parent threads were parked on one, unlock still
+    // issues a FUTEX_WAKE, but those threads don't exist in the child, so the
+    // wake finds no waiters and returns.
+    for (auto& mutex : m_transferCacheMutexes)
+        mutex.unlock();
+    m_vmHeap.mutex().unlock();
+    m_xLargeMutex.unlock();
+    m_largeMutex.unlock();
+    m_pagesMutex.unlock();
+    for (auto& mutex : m_mediumLargeMutexes)
+        mutex.unlock();
+    for (auto& mutex : m_mediumMutexes)
+        mutex.unlock();
+    for (auto& mutex : m_smallMutexes)
+        mutex.unlock();
+}
+
+void Heap::scavengeTransferCache(size_t sizeClass)
+{
+    BumpRangeCache bumpRangeCache;
+    while (m_transferCaches[sizeClass].tryPop(bumpRangeCache)) {
+        for (auto& bumpRange : bumpRangeCache) {
+            char* object = bumpRange.begin;
+            for (unsigned short i = 0; i < bumpRange.objectCount; ++i, object += objectSize(sizeClass))
+                derefLine(object);
+        }
+        bumpRangeCache.clear();
+    }
+}
+
+void Heap::scavengeTransferCaches()
+{
+    for (size_t sizeClass = 0; sizeClass < m_transferCaches.size(); ++sizeClass)
+        scavengeTransferCache(sizeClass);
+}
+
+void Heap::scavengeIdleTransferCaches()
+{
+    // Threads trade batches through busy transfer caches, so we leave those
+    // alone until they go unused for a whole pass.
+    for (size_t sizeClass = 0; sizeClass < m_transferCaches.size(); ++sizeClass) {
+        if (!m_transferCaches[sizeClass].clearWasUsed())
+            scavengeTransferCache(sizeClass);
     }
 }
 
-void Heap::scavengeMediumPages(std::unique_lock<StaticMutex>& lock, std::chrono::milliseconds sleepDuration)
+template<typename Page>
+void Heap::scavengePages(Vector<Page*>& pages, std::chrono::milliseconds sleepDuration)
 {
-    while (m_mediumPages.size()) {
-        m_vmHeap.deallocateMediumPage(lock, m_mediumPages.pop());
+    std::unique_lock<StaticMutex> lock(m_pagesMutex);
+    waitUntilFalse(lock, sleepDuration, m_isAllocatingPages);
+
+    while (pages.size()) {
+        FixedVector<Page*, scavengeBatchSize> batch;
+        size_t count = min(pages.size(), batch.capacity());
+        batch.push(pages.end() - count, pages.end());
+        pages.shrink(pages.size() - count);
+
+        lock.unlock();
+        m_vmHeap.deallocatePages(batch.begin(), batch.size());
+        lock.lock();
+
         waitUntilFalse(lock, sleepDuration, m_isAllocatingPages);
     }
 }
 
-void Heap::scavengeLargeObjects(std::unique_lock<StaticMutex>& lock, std::chrono::milliseconds sleepDuration)
+void Heap::scavengeLargeObjects(std::chrono::milliseconds sleepDuration)
 {
+    std::unique_lock<StaticMutex> lock(m_largeMutex);
+    waitUntilFalse(lock, sleepDuration, m_isAllocatingLargeObjects);
+
     while (LargeObject largeObject = m_largeObjects.takeGreedy()) {
         m_vmHeap.deallocateLargeObject(lock, largeObject);
-        waitUntilFalse(lock, sleepDuration, m_isAllocatingPages);
+        waitUntilFalse(lock, sleepDuration, m_isAllocatingLargeObjects);
+    }
+}
+
+NO_INLINE void Heap::processRemoteFreesSlowCase()
+{
+    void* object = m_remoteFrees.exchange(nullptr, std::memory_order_acquire);
+    while (object) {
+        // Once we drop our reference, the object may be reallocated.
+        void* next = *static_cast<void**>(object);
+        derefLine(object);
+        object = next;
     }
 }
 
-void Heap::refillSmallBumpRangeCache(std::lock_guard<StaticMutex>& lock, size_t sizeClass, BumpRangeCache& rangeCache)
+size_t Heap::refillSmallBumpRangeCache(std::lock_guard<StaticMutex>& lock, size_t sizeClass, BumpRangeCache& rangeCache, size_t pageCount)
+{
+    BASSERT(!rangeCache.size());
+    BASSERT(pageCount);
+    ++m_refillStatistics[sizeClass].count;
+
+    for (; pageCount && rangeCache.size() != rangeCache.capacity(); --pageCount)
+        allocateSmallBumpRanges(lock, sizeClass, rangeCache);
+    return pageCount;
+}
+
+size_t Heap::refillMediumBumpRangeCache(std::lock_guard<StaticMutex>& lock, size_t sizeClass, BumpRangeCache& rangeCache, size_t pageCount)
+{
+    BASSERT(!rangeCache.size());
+    BASSERT(pageCount);
+    ++m_refillStatistics[sizeClass].count;
+
+    for (; pageCount && rangeCache.size() != rangeCache.capacity(); --pageCount)
+        allocateMediumBumpRanges(lock, sizeClass, rangeCache);
+    return pageCount;
+}
+
+size_t Heap::refillMediumLargeBumpRangeCache(std::lock_guard<StaticMutex>& lock, size_t sizeClass, BumpRangeCache& rangeCache, size_t pageCount)
 {
     BASSERT(!rangeCache.size());
+    BASSERT(pageCount);
+    ++m_refillStatistics[sizeClass].count;
+
+    for (; pageCount && rangeCache.size() != rangeCache.capacity(); --pageCount)
+        allocateMediumLargeBumpRanges(lock, sizeClass, rangeCache);
+    return pageCount;
+}
+
+double Heap::refillsPerSecond(std::lock_guard<StaticMutex>&, size_t sizeClass)
+{
+    RefillStatistics& statistics = m_refillStatistics[sizeClass];
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - statistics.sampleTime;
+    double result = elapsed.count() ? (statistics.count - statistics.sampleCount) / elapsed.count() : 0;
+
+    statistics.sampleCount = statistics.count;
+    statistics.sampleTime = now;
+    return result;
+}
+
+void Heap::allocateSmallBumpRanges(std::lock_guard<StaticMutex>& lock, size_t sizeClass, BumpRangeCache& rangeCache)
+{
     SmallPage* page = allocateSmallPage(lock, sizeClass);
     SmallLine* lines = page->begin();
 
@@ -132,34 +448,39 @@ void Heap::refillSmallBumpRangeCache(std::lock_guard<StaticMutex>& lock, size_t
 
     // Find a free line.
     for (size_t lineNumber = 0; lineNumber < end; ++lineNumber) {
-        if (lines[lineNumber].refCount(lock))
+        if (lines[lineNumber].refCount())
             continue;
 
+        // Our cache is full, so we leave the rest of the page for later.
+        if (rangeCache.size() == rangeCache.capacity()) {
+            m_smallPagesWithFreeLines[sizeClass].push(page);
+            return;
+        }
+
         LineMetadata& lineMetadata = m_smallLineMetadata[sizeClass][lineNumber];
         char* begin = lines[lineNumber].begin() + lineMetadata.startOffset;
         unsigned short objectCount = lineMetadata.objectCount;
-        lines[lineNumber].ref(lock, lineMetadata.objectCount);
-        page->ref(lock);
+        lines[lineNumber].ref(lineMetadata.objectCount);
+        page->ref();
 
         // Merge with subsequent free lines.
         while (++lineNumber < end) {
-            if (lines[lineNumber].refCount(lock))
+            if (lines[lineNumber].refCount())
                 break;
 
             LineMetadata& lineMetadata = m_smallLineMetadata[sizeClass][lineNumber];
             objectCount += lineMetadata.objectCount;
-            lines[lineNumber].ref(lock, lineMetadata.objectCount);
-            page->ref(lock);
+            lines[lineNumber].ref(lineMetadata.objectCount);
+            page->ref();
         }
 
         rangeCache.push({ begin, objectCount });
     }
 }
 
-void Heap::refillMediumBumpRangeCache(std::lock_guard<StaticMutex>& lock, size_t sizeClass, BumpRangeCache& rangeCache)
+void Heap::allocateMediumBumpRanges(std::lock_guard<StaticMutex>& lock, size_t sizeClass, BumpRangeCache& rangeCache)
 {
     MediumPage* page = allocateMediumPage(lock, sizeClass);
-    BASSERT(!rangeCache.size());
     MediumLine* lines = page->begin();
 
     // Due to overlap from the previous line, the last line in the page may not be able to fit any objects.
@@ -169,36 +490,85 @@ void Heap::refillMediumBumpRangeCache(std::lock_guard<StaticMutex>& lock, size_t
 
     // Find a free line.
     for (size_t lineNumber = 0; lineNumber < end; ++lineNumber) {
-        if (lines[lineNumber].refCount(lock))
+        if (lines[lineNumber].refCount())
             continue;
 
+        if (rangeCache.size() == rangeCache.capacity()) {
+            m_mediumPagesWithFreeLines[sizeClass].push(page);
+            return;
+        }
+
         LineMetadata& lineMetadata = m_mediumLineMetadata[sizeClass][lineNumber];
         char* begin = lines[lineNumber].begin() + lineMetadata.startOffset;
         unsigned short objectCount = lineMetadata.objectCount;
-        lines[lineNumber].ref(lock, lineMetadata.objectCount);
-        page->ref(lock);
+        lines[lineNumber].ref(lineMetadata.objectCount);
+        page->ref();
         
         // Merge with subsequent free lines.
         while (++lineNumber < end) {
-            if (lines[lineNumber].refCount(lock))
+            if (lines[lineNumber].refCount())
                 break;
 
             LineMetadata& lineMetadata = m_mediumLineMetadata[sizeClass][lineNumber];
             objectCount += lineMetadata.objectCount;
-            lines[lineNumber].ref(lock, lineMetadata.objectCount);
-            page->ref(lock);
+            lines[lineNumber].ref(lineMetadata.objectCount);
+            page->ref();
+        }
+
+        rangeCache.push({ begin, objectCount });
+    }
+}
+
+void Heap::allocateMediumLargeBumpRanges(std::lock_guard<StaticMutex>& lock, size_t sizeClass, BumpRangeCache& rangeCache)
+{
+    MediumLargePage* page = allocateMediumLargePage(lock, sizeClass);
+    MediumLargeLine* lines = page->begin();
+    auto& lineMetadata = m_mediumLargeLineMetadata[sizeClass - mediumSizeClassCount];
+
+    // Due to overlap from the previous line, the last line in the page may not be able to fit any objects.
+    size_t end = MediumLargePage::lineCount;
+    if (!lineMetadata[MediumLargePage::lineCount - 1].objectCount)
+        --end;
+
+    // Find a free line.
+    for (size_t lineNumber = 0; lineNumber < end; ++lineNumber) {
+        if (lines[lineNumber].refCount())
+            continue;
+
+        if (rangeCache.size() == rangeCache.capacity()) {
+            m_mediumLargePagesWithFreeLines[sizeClass - mediumSizeClassCount].push(page);
+            return;
+        }
+
+        char* begin = lines[lineNumber].begin() + lineMetadata[lineNumber].startOffset;
+        unsigned short objectCount = lineMetadata[lineNumber].objectCount;
+        lines[lineNumber].ref(lineMetadata[lineNumber].objectCount);
+        page->ref();
+
+        // Merge with subsequent free lines.
+        while (++lineNumber < end) {
+            if (lines[lineNumber].refCount())
+                break;
+
+            objectCount += lineMetadata[lineNumber].objectCount;
+            lines[lineNumber].ref(lineMetadata[lineNumber].objectCount);
+            page->ref();
         }
 
         rangeCache.push({ begin, objectCount });
     }
 }
 
-SmallPage* Heap::allocateSmallPage(std::lock_guard<StaticMutex>& lock, size_t sizeClass)
+SmallPage* Heap::allocateSmallPage(std::lock_guard<StaticMutex>&, size_t sizeClass)
 {
     Vector<SmallPage*>& smallPagesWithFreeLines = m_smallPagesWithFreeLines[sizeClass];
+
+    // Pages in our list may have been promoted to the pages list and handed to
+    // another size class. The pages lock pins their size class while we check.
+    std::lock_guard<StaticMutex> pagesLock(m_pagesMutex);
     while (smallPagesWithFreeLines.size()) {
         SmallPage* page = smallPagesWithFreeLines.pop();
-        if (!page->refCount(lock) || page->sizeClass() != sizeClass) // Page was promoted to the pages list.
+        if (page->sizeClass() != sizeClass || !page->refCount()) // Page was promoted to the pages list.
             continue;
         return page;
     }
@@ -215,12 +585,16 @@ SmallPage* Heap::allocateSmallPage(std::lock_guard<StaticMutex>& lock, size_t si
     return page;
 }
 
-MediumPage* Heap::allocateMediumPage(std::lock_guard<StaticMutex>& lock, size_t sizeClass)
+MediumPage* Heap::allocateMediumPage(std::lock_guard<StaticMutex>&, size_t sizeClass)
 {
     Vector<MediumPage*>& mediumPagesWithFreeLines = m_mediumPagesWithFreeLines[sizeClass];
+
+    // Pages in our list may have been promoted to the pages list and handed to
+    // another size class. The pages lock pins their size class while we check.
+    std::lock_guard<StaticMutex> pagesLock(m_pagesMutex);
     while (mediumPagesWithFreeLines.size()) {
         MediumPage* page = mediumPagesWithFreeLines.pop();
-        if (!page->refCount(lock) || page->sizeClass() != sizeClass) // Page was promoted to the pages list.
+        if (page->sizeClass() != sizeClass || !page->refCount()) // Page was promoted to the pages list.
             continue;
         return page;
     }
@@ -237,12 +611,38 @@ MediumPage* Heap::allocateMediumPage(std::lock_guard<StaticMutex>& lock, size_t
     return page;
 }
 
-void Heap::deallocateSmallLine(std::lock_guard<StaticMutex>& lock, SmallLine* line)
+MediumLargePage* Heap::allocateMediumLargePage(std::lock_guard<StaticMutex>&, size_t sizeClass)
+{
+    Vector<MediumLargePage*>& mediumLargePagesWithFreeLines = m_mediumLargePagesWithFreeLines[sizeClass - mediumSizeClassCount];
+
+    // Pages in our list may have been promoted to the pages list and handed to
+    // another size class. The pages lock pins their size class while we check.
+    std::lock_guard<StaticMutex> pagesLock(m_pagesMutex);
+    while (mediumLargePagesWithFreeLines.size()) {
+        MediumLargePage* page = mediumLargePagesWithFreeLines.pop();
+        if (page->sizeClass() != sizeClass || !page->refCount()) // Page was promoted to the pages list.
+            continue;
+        return page;
+    }
+
+    MediumLargePage* page = [this, sizeClass]() {
+        if (m_mediumLargePages.size())
+            return m_mediumLargePages.pop();
+
+        m_isAllocatingPages = true;
+        return m_vmHeap.allocateMediumLargePage();
+    }();
+
+    page->setSizeClass(sizeClass);
+    return page;
+}
+
+void Heap::deallocateSmallLine(std::lock_guard<StaticMutex>&, SmallLine* line)
 {
-    BASSERT(!line->refCount(lock));
+    BASSERT(!line->refCount());
     SmallPage* page = SmallPage::get(line);
-    size_t refCount = page->refCount(lock);
-    page->deref(lock);
+    size_t refCount = page->refCount();
+    page->deref();
 
     switch (refCount) {
     case SmallPage::lineCount: {
@@ -252,6 +652,8 @@ void Heap::deallocateSmallLine(std::lock_guard<StaticMutex>& lock, SmallLine* li
     }
     case 1: {
         // Last free line in the page.
+        std::lock_guard<StaticMutex> pagesLock(m_pagesMutex);
+        page->setFreeTime(decayClock());
         m_smallPages.push(page);
         m_scavenger.run();
         break;
@@ -259,12 +661,12 @@ void Heap::deallocateSmallLine(std::lock_guard<StaticMutex>& lock, SmallLine* li
     }
 }
 
-void Heap::deallocateMediumLine(std::lock_guard<StaticMutex>& lock, MediumLine* line)
+void Heap::deallocateMediumLine(std::lock_guard<StaticMutex>&, MediumLine* line)
 {
-    BASSERT(!line->refCount(lock));
+    BASSERT(!line->refCount());
     MediumPage* page = MediumPage::get(line);
-    size_t refCount = page->refCount(lock);
-    page->deref(lock);
+    size_t refCount = page->refCount();
+    page->deref();
 
     switch (refCount) {
     case MediumPage::lineCount: {
@@ -274,6 +676,8 @@ void Heap::deallocateMediumLine(std::lock_guard<StaticMutex>& lock, MediumLine*
     }
     case 1: {
         // Last free line in the page.
+        std::lock_guard<StaticMutex> pagesLock(m_pagesMutex);
+        page->setFreeTime(decayClock());
         m_mediumPages.push(page);
         m_scavenger.run();
         break;
@@ -281,49 +685,57 @@ void Heap::deallocateMediumLine(std::lock_guard<StaticMutex>& lock, MediumLine*
     }
 }
 
-void* Heap::allocateXLarge(std::lock_guard<StaticMutex>& lock, size_t alignment, size_t size)
+void Heap::deallocateMediumLargeLine(std::lock_guard<StaticMutex>&, MediumLargeLine* line)
 {
-    void* result = tryAllocateXLarge(lock, alignment, size);
-    RELEASE_BASSERT(result);
-    return result;
+    BASSERT(!line->refCount());
+    MediumLargePage* page = MediumLargePage::get(line);
+    size_t refCount = page->refCount();
+    page->deref();
+
+    switch (refCount) {
+    case MediumLargePage::lineCount: {
+        // First free line in the page.
+        m_mediumLargePagesWithFreeLines[page->sizeClass() - mediumSizeClassCount].push(page);
+        break;
+    }
+    case 1: {
+        // Last free line in the page.
+        std::lock_guard<StaticMutex> pagesLock(m_pagesMutex);
+        page->setFreeTime(decayClock());
+        m_mediumLargePages.push(page);
+        m_scavenger.run();
+        break;
+    }
+    }
 }
 
-void* Heap::allocateXLarge(std::lock_guard<StaticMutex>& lock, size_t size)
+void Heap::insertXLarge(std::lock_guard<StaticMutex>&, const XLargeRange& range)
 {
-    return allocateXLarge(lock, superChunkSize, size);
+    BASSERT(shard(range.begin()) == m_shard);
+    m_xLargeObjects.add(range.begin(), range);
 }
 
-void* Heap::tryAllocateXLarge(std::lock_guard<StaticMutex>&, size_t alignment, size_t size)
+XLargeRange& Heap::findXLarge(std::unique_lock<StaticMutex>&, void* object)
 {
-    BASSERT(isPowerOfTwo(alignment));
-    BASSERT(alignment >= superChunkSize);
-    BASSERT(size == roundUpToMultipleOf<xLargeAlignment>(size));
-
-    void* result = tryVMAllocate(alignment, size);
-    if (!result)
-        return nullptr;
-    m_xLargeObjects.push(Range(result, size));
-    return result;
+    XLargeRange* range = m_xLargeObjects.find(object);
+    RELEASE_BASSERT(range);
+    return *range;
 }
 
-Range& Heap::findXLarge(std::unique_lock<StaticMutex>&, void* object)
+XLargeRange Heap::takeXLarge(std::unique_lock<StaticMutex>&, void* object)
 {
-    for (auto& range : m_xLargeObjects) {
-        if (range.begin() != object)
-            continue;
-        return range;
-    }
-
-    RELEASE_BASSERT(false);
-    return *static_cast<Range*>(nullptr); // Silence compiler error.
+    return m_xLargeObjects.take(object);
 }
 
 void Heap::deallocateXLarge(std::unique_lock<StaticMutex>& lock, void* object)
 {
-    Range toDeallocate = m_xLargeObjects.pop(&findXLarge(lock, object));
+    XLargeRange toDeallocate = takeXLarge(lock, object);
 
     lock.unlock();
-    vmDeallocate(toDeallocate.begin(), toDeallocate.size());
+    if (toDeallocate.isHugeTLB())
+        PerProcess<HugeTLBPool>::get()->deallocate(toDeallocate);
+    else
+        vmDeallocate(toDeallocate.begin(), toDeallocate.size());
     lock.lock();
 }
 
@@ -342,18 +754,48 @@ void* Heap::allocateLarge(std::lock_guard<StaticMutex>&, LargeObject& largeObjec
 }
 
 void* Heap::allocateLarge(std::lock_guard<StaticMutex>& lock, size_t size)
+{
+    bool isZeroed;
+    return allocateLarge(lock, size, isZeroed);
+}
+
+// Zeroes the parts of a range that only partly cover a page.
+static void zeroPartialPages(const Range& range)
+{
+    char* begin = roundUpToMultipleOf<vmPageSize>(range.begin());
+    char* end = roundDownToMultipleOf<vmPageSize>(range.end());
+    if (begin >= end) {
+        memset(range.begin(), 0, range.size());
+        return;
+    }
+
+    memset(range.begin(), 0, begin - range.begin());
+    memset(end, 0, range.end() - end);
+}
+
+void* Heap::allocateLarge(std::lock_guard<StaticMutex>& lock, size_t size, bool& isZeroed)
 {
     BASSERT(size <= largeMax);
     BASSERT(size >= largeMin);
     BASSERT(size == roundUpToMultipleOf<largeAlignment>(size));
     
+    isZeroed = false;
     LargeObject largeObject = m_largeObjects.take(size);
-    if (!largeObject) {
-        m_isAllocatingPages = true;
-        largeObject = m_vmHeap.allocateLargeObject(size);
-    }
-
-    return allocateLarge(lock, largeObject, size);
+    if (largeObject)
+        return allocateLarge(lock, largeObject, size);
+
+    m_isAllocatingLargeObjects = true;
+    largeObject = m_vmHeap.allocateLargeObject(lock, size);
+    void* result = allocateLarge(lock, largeObject, size);
+
+    // The VM heap's ranges are either fresh from the OS or have had their
+    // physical pages deallocated, unless they're huge TLB pages, which we
+    // never deallocate. Pages shared with a neighbor stay behind, though, so
+    // we zero the object's partial pages ourselves.
+    isZeroed = vmDeallocatePhysicalPagesZeroes && !LargeChunk::get(result)->isHugeTLB();
+    if (isZeroed)
+        zeroPartialPages(largeObject.range());
+    return result;
 }
 
 void* Heap::allocateLarge(std::lock_guard<StaticMutex>& lock, size_t alignment, size_t size, size_t unalignedSize)
@@ -370,8 +812,8 @@ void* Heap::allocateLarge(std::lock_guard<StaticMutex>& lock, size_t alignment,
 
     LargeObject largeObject = m_largeObjects.take(alignment, size, unalignedSize);
     if (!largeObject) {
-        m_isAllocatingPages = true;
-        largeObject = m_vmHeap.allocateLargeObject(alignment, size, unalignedSize);
+        m_isAllocatingLargeObjects = true;
+        largeObject = m_vmHeap.allocateLargeObject(lock, alignment, size, unalignedSize);
     }
 
     size_t alignmentMask = alignment - 1;
@@ -385,6 +827,27 @@ void* Heap::allocateLarge(std::lock_guard<StaticMutex>& lock, size_t alignment,
     return allocateLarge(lock, largeObject, size);
 }
 
+bool Heap::extendLarge(std::unique_lock<StaticMutex>&, void* object, size_t size)
+{
+    BASSERT(size <= largeMax);
+    BASSERT(size == roundUpToMultipleOf<largeAlignment>(size));
+
+    LargeObject largeObject(object);
+    BASSERT(largeObject.size() < size);
+
+    LargeObject extended = largeObject.extend(size);
+    if (!extended)
+        return false;
+
+    if (extended.size() - size > largeMin) {
+        std::pair<LargeObject, LargeObject> split = extended.split(size);
+        split.second.setFree(true);
+        m_largeObjects.insert(split.second);
+    }
+
+    return true;
+}
+
 void Heap::deallocateLarge(std::lock_guard<StaticMutex>&, const LargeObject& largeObject)
 {
     BASSERT(!largeObject.isFree());
@@ -392,6 +855,7 @@ void Heap::deallocateLarge(std::lock_guard<StaticMutex>&, const LargeObject& lar
     
     LargeObject merged = largeObject.merge();
     m_largeObjects.insert(merged);
+    m_largeFreeTime = decayClock();
     m_scavenger.run();
 }
 
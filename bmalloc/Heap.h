@@ -27,9 +27,16 @@
 #define Heap_h
 
 #include "BumpRange.h"
+#include "Decay.h"
 #include "Environment.h"
+#include "Inline.h"
+#include "LargeChunk.h"
 #include "LineMetadata.h"
+#include "Map.h"
 #include "MediumChunk.h"
+#include "MediumLargeChunk.h"
+#include "MediumLargeLine.h"
+#include "MediumLargePage.h"
 #include "MediumLine.h"
 #include "MediumPage.h"
 #include "Mutex.h"
@@ -37,9 +44,13 @@
 #include "SmallChunk.h"
 #include "SmallLine.h"
 #include "SmallPage.h"
+#include "TransferCache.h"
 #include "VMHeap.h"
 #include "Vector.h"
+#include "XLargeRange.h"
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <mutex>
 
 namespace bmalloc {
@@ -47,29 +58,98 @@ namespace bmalloc {
 class BeginTag;
 class EndTag;
 
+// One of heapShardCount independent heaps. Objects are owned by the shard that
+// allocated their SuperChunk, so a free must go to the owner, not the caller's
+// shard.
+//
+// Each shard splits its state across several locks, so threads working with
+// different structures don't contend:
+//
+//     - one lock per small, medium and medium-large size class, for its
+//       lines and pages with free lines;
+//     - a pages lock, for free pages and page size class assignment;
+//     - a large object lock, for large free lists and boundary tags;
+//     - an XLarge lock, for the XLarge object map;
+//     - the VMHeap's own lock.
+//
+// Size class locks come before the pages lock, which comes before the VMHeap
+// lock. The large object lock also comes before the VMHeap lock.
+//
+// Small, medium and medium-large objects freed by threads bound to other shards come back
+// through a lock-free remote free list, which we process in bulk. Unused bump
+// ranges from exiting or scavenged thread caches go to a per-size-class
+// transfer cache, so other threads can reuse them without scanning pages.
+
 class Heap {
 public:
-    Heap(std::lock_guard<StaticMutex>&);
-    
+    Heap(std::lock_guard<StaticMutex>&, size_t shard);
+
+    static size_t shard(void*);
+
+    size_t shard() { return m_shard; }
     Environment& environment() { return m_environment; }
 
-    void refillSmallBumpRangeCache(std::lock_guard<StaticMutex>&, size_t sizeClass, BumpRangeCache&);
-    void derefSmallLine(std::lock_guard<StaticMutex>&, SmallLine*);
+    StaticMutex& smallMutex(size_t sizeClass) { return m_smallMutexes[sizeClass]; }
+    StaticMutex& mediumMutex(size_t sizeClass) { return m_mediumMutexes[sizeClass]; }
+    StaticMutex& mediumLargeMutex(size_t sizeClass) { return m_mediumLargeMutexes[sizeClass - mediumSizeClassCount]; }
+    StaticMutex& largeMutex() { return m_largeMutex; }
+    StaticMutex& xLargeMutex() { return m_xLargeMutex; }
+
+    TransferCache& transferCache(size_t sizeClass) { return m_transferCaches[sizeClass]; }
+
+    // Drops the references of count small, medium or medium-large objects in
+    // the same line. Takes the size class lock only for the line's last
+    // references.
+    void derefLine(void*, unsigned char count = 1);
+
+    // Pushes a chain of freed objects, linked through their first word, for
+    // our scavenger or our next refill to process.
+    void pushRemoteFrees(void* head, void* tail);
+    void processRemoteFrees();
 
-    void refillMediumBumpRangeCache(std::lock_guard<StaticMutex>&, size_t sizeClass, BumpRangeCache&);
-    void derefMediumLine(std::lock_guard<StaticMutex>&, MediumLine*);
+    // Refills take ranges from up to pageCount pages, as long as they fit, and
+    // return how many pages they didn't get to.
+    size_t refillSmallBumpRangeCache(std::lock_guard<StaticMutex>&, size_t sizeClass, BumpRangeCache&, size_t pageCount);
+    void derefSmallLine(std::lock_guard<StaticMutex>&, SmallLine*, unsigned char count = 1);
+
+    size_t refillMediumBumpRangeCache(std::lock_guard<StaticMutex>&, size_t sizeClass, BumpRangeCache&, size_t pageCount);
+    void derefMediumLine(std::lock_guard<StaticMutex>&, MediumLine*, unsigned char count = 1);
+
+    size_t refillMediumLargeBumpRangeCache(std::lock_guard<StaticMutex>&, size_t sizeClass, BumpRangeCache&, size_t pageCount);
+    void derefMediumLargeLine(std::lock_guard<StaticMutex>&, MediumLargeLine*, unsigned char count = 1);
+
+    // Refills of the size class per second, since the previous call. Requires
+    // the size class lock.
+    double refillsPerSecond(std::lock_guard<StaticMutex>&, size_t sizeClass);
 
     void* allocateLarge(std::lock_guard<StaticMutex>&, size_t);
     void* allocateLarge(std::lock_guard<StaticMutex>&, size_t alignment, size_t, size_t unalignedSize);
+
+    // Like allocateLarge, but also reports whether the object's memory is
+    // known to be zero, which is the case when it comes from the VM heap.
+    // Zeroes the object's partial pages, which the VM heap can't decommit.
+    void* allocateLarge(std::lock_guard<StaticMutex>&, size_t, bool& isZeroed);
     void deallocateLarge(std::lock_guard<StaticMutex>&, void*);
 
-    void* allocateXLarge(std::lock_guard<StaticMutex>&, size_t);
-    void* allocateXLarge(std::lock_guard<StaticMutex>&, size_t alignment, size_t);
-    void* tryAllocateXLarge(std::lock_guard<StaticMutex>&, size_t alignment, size_t);
-    Range& findXLarge(std::unique_lock<StaticMutex>&, void*);
+    // Grows a large object in place to the provided size, using free space to
+    // its right. Returns false, without changing the object, if there isn't enough.
+    bool extendLarge(std::unique_lock<StaticMutex>&, void*, size_t);
+
+    void insertXLarge(std::lock_guard<StaticMutex>&, const XLargeRange&);
+    XLargeRange& findXLarge(std::unique_lock<StaticMutex>&, void*);
+    XLargeRange takeXLarge(std::unique_lock<StaticMutex>&, void*);
     void deallocateXLarge(std::unique_lock<StaticMutex>&, void*);
 
-    void scavenge(std::unique_lock<StaticMutex>&, std::chrono::milliseconds sleepDuration);
+    void scavenge(std::chrono::milliseconds sleepDuration);
+
+    HugePageStatistics hugePageStatistics() { return m_vmHeap.hugePageStatistics(); }
+
+    // fork() support. forkPrepare takes every lock, so the child gets a
+    // consistent heap, and forkParent and forkChild release them. The child
+    // has no scavenger thread, so it starts a new one when it needs it.
+    void forkPrepare();
+    void forkParent();
+    void forkChild();
 
 private:
     ~Heap() = delete;
@@ -78,9 +158,17 @@ private:
 
     SmallPage* allocateSmallPage(std::lock_guard<StaticMutex>&, size_t sizeClass);
     MediumPage* allocateMediumPage(std::lock_guard<StaticMutex>&, size_t sizeClass);
+    MediumLargePage* allocateMediumLargePage(std::lock_guard<StaticMutex>&, size_t sizeClass);
+
+    void processRemoteFreesSlowCase();
+
+    void allocateSmallBumpRanges(std::lock_guard<StaticMutex>&, size_t sizeClass, BumpRangeCache&);
+    void allocateMediumBumpRanges(std::lock_guard<StaticMutex>&, size_t sizeClass, BumpRangeCache&);
+    void allocateMediumLargeBumpRanges(std::lock_guard<StaticMutex>&, size_t sizeClass, BumpRangeCache&);
 
     void deallocateSmallLine(std::lock_guard<StaticMutex>&, SmallLine*);
     void deallocateMediumLine(std::lock_guard<StaticMutex>&, MediumLine*);
+    void deallocateMediumLargeLine(std::lock_guard<StaticMutex>&, MediumLargeLine*);
 
     void* allocateLarge(std::lock_guard<StaticMutex>&, LargeObject&, size_t);
     void deallocateLarge(std::lock_guard<StaticMutex>&, const LargeObject&);
@@ -90,45 +178,168 @@ private:
     void mergeLargeLeft(EndTag*&, BeginTag*&, Range&, bool& inVMHeap);
     void mergeLargeRight(EndTag*&, BeginTag*&, Range&, bool& inVMHeap);
     
+    void unlockAfterFork();
+
+    // The scavenger thread returns free memory to the OS gradually, as it
+    // decays. Returns true if free memory remains.
     void concurrentScavenge();
-    void scavengeSmallPages(std::unique_lock<StaticMutex>&, std::chrono::milliseconds);
-    void scavengeMediumPages(std::unique_lock<StaticMutex>&, std::chrono::milliseconds);
-    void scavengeLargeObjects(std::unique_lock<StaticMutex>&, std::chrono::milliseconds);
+    bool decay();
+    template<typename Page> bool decayPages(Vector<Page*>&, size_t& budget);
+    bool decayLargeObjects(size_t& budget);
+
+    void scavengeTransferCache(size_t sizeClass);
+    void scavengeTransferCaches();
+    void scavengeIdleTransferCaches();
+    template<typename Page> void scavengePages(Vector<Page*>&, std::chrono::milliseconds);
+    void scavengeLargeObjects(std::chrono::milliseconds);
 
     std::array<std::array<LineMetadata, SmallPage::lineCount>, smallMax / alignment> m_smallLineMetadata;
     std::array<std::array<LineMetadata, MediumPage::lineCount>, mediumMax / alignment> m_mediumLineMetadata;
+    std::array<std::array<LineMetadata, MediumLargePage::lineCount>, mediumLargeSizeClassCount> m_mediumLargeLineMetadata;
 
+    std::array<Mutex, smallMax / alignment> m_smallMutexes;
+    std::array<Mutex, mediumMax / alignment> m_mediumMutexes;
+    std::array<Mutex, mediumLargeSizeClassCount> m_mediumLargeMutexes;
     std::array<Vector<SmallPage*>, smallMax / alignment> m_smallPagesWithFreeLines;
     std::array<Vector<MediumPage*>, mediumMax / alignment> m_mediumPagesWithFreeLines;
+    std::array<Vector<MediumLargePage*>, mediumLargeSizeClassCount> m_mediumLargePagesWithFreeLines;
+
+    std::array<Mutex, sizeClassCount> m_transferCacheMutexes;
+    std::array<TransferCache, sizeClassCount> m_transferCaches;
+
+    // Guarded by the size class lock.
+    struct RefillStatistics {
+        size_t count;
+        size_t sampleCount;
+        std::chrono::steady_clock::time_point sampleTime;
+    };
+    std::array<RefillStatistics, sizeClassCount> m_refillStatistics;
 
+    Mutex m_pagesMutex;
+    // Free pages, in the order they were freed.
     Vector<SmallPage*> m_smallPages;
     Vector<MediumPage*> m_mediumPages;
+    Vector<MediumLargePage*> m_mediumLargePages;
+    bool m_isAllocatingPages;
 
+    Mutex m_largeMutex;
     SegregatedFreeList m_largeObjects;
-    Vector<Range> m_xLargeObjects;
+    bool m_isAllocatingLargeObjects;
+    unsigned m_largeFreeTime; // When we last freed a large object, in decayClock() time.
 
-    bool m_isAllocatingPages;
+    // XLarge objects are superChunkSize aligned, so we hash by chunk number.
+    struct XLargeHash {
+        static size_t hash(void* object)
+        {
+            uint64_t key = reinterpret_cast<uintptr_t>(object) / superChunkSize;
+            key *= 0x9e3779b97f4a7c15ull;
+            return static_cast<size_t>(key ^ (key >> 32));
+        }
+    };
+
+    Mutex m_xLargeMutex;
+    Map<void*, XLargeRange, XLargeHash> m_xLargeObjects;
 
+    std::atomic<void*> m_remoteFrees;
+
+    size_t m_shard;
     Environment m_environment;
 
     VMHeap m_vmHeap;
     AsyncTask<Heap, decltype(&Heap::concurrentScavenge)> m_scavenger;
 };
 
-inline void Heap::derefSmallLine(std::lock_guard<StaticMutex>& lock, SmallLine* line)
+inline size_t Heap::shard(void* object)
+{
+    if (isSmallOrMedium(object)) {
+        if (isSmall(object))
+            return SmallChunk::get(object)->shard();
+        if (isMediumLarge(object))
+            return MediumLargeChunk::get(object)->shard();
+        return MediumChunk::get(object)->shard();
+    }
+
+    if (!isXLarge(object))
+        return LargeChunk::get(object)->shard();
+
+    // XLarge objects don't live in a SuperChunk, so we spread them across
+    // shards by address instead.
+    return (reinterpret_cast<uintptr_t>(object) / superChunkSize) % heapShardCount;
+}
+
+inline void Heap::derefLine(void* object, unsigned char count)
+{
+    if (isSmall(object)) {
+        SmallLine* line = SmallLine::get(object);
+        if (line->tryDeref(count))
+            return;
+
+        std::lock_guard<StaticMutex> lock(m_smallMutexes[SmallPage::get(line)->sizeClass()]);
+        derefSmallLine(lock, line, count);
+        return;
+    }
+
+    if (isMediumLarge(object)) {
+        MediumLargeLine* line = MediumLargeLine::get(object);
+        if (line->tryDeref(count))
+            return;
+
+        std::lock_guard<StaticMutex> lock(mediumLargeMutex(MediumLargePage::get(line)->sizeClass()));
+        derefMediumLargeLine(lock, line, count);
+        return;
+    }
+
+    BASSERT(isMedium(object));
+    MediumLine* line = MediumLine::get(object);
+    if (line->tryDeref(count))
+        return;
+
+    std::lock_guard<StaticMutex> lock(m_mediumMutexes[MediumPage::get(line)->sizeClass()]);
+    derefMediumLine(lock, line, count);
+}
+
+inline void Heap::pushRemoteFrees(void* head, void* tail)
 {
-    if (!line->deref(lock))
+    BASSERT(shard(head) == m_shard);
+    void* oldHead = m_remoteFrees.load(std::memory_order_relaxed);
+    do {
+        *static_cast<void**>(tail) = oldHead;
+    } while (!m_remoteFrees.compare_exchange_weak(oldHead, head, std::memory_order_release, std::memory_order_relaxed));
+
+    // Our own threads may be idle or gone, so the scavenger makes sure the
+    // list gets processed. It only needs waking for the first push.
+    if (!oldHead)
+        m_scavenger.run();
+}
+
+inline void Heap::processRemoteFrees()
+{
+    if (!m_remoteFrees.load(std::memory_order_relaxed))
+        return;
+    processRemoteFreesSlowCase();
+}
+
+inline void Heap::derefSmallLine(std::lock_guard<StaticMutex>& lock, SmallLine* line, unsigned char count)
+{
+    if (!line->deref(count))
         return;
     deallocateSmallLine(lock, line);
 }
 
-inline void Heap::derefMediumLine(std::lock_guard<StaticMutex>& lock, MediumLine* line)
+inline void Heap::derefMediumLine(std::lock_guard<StaticMutex>& lock, MediumLine* line, unsigned char count)
 {
-    if (!line->deref(lock))
+    if (!line->deref(count))
         return;
     deallocateMediumLine(lock, line);
 }
 
+inline void Heap::derefMediumLargeLine(std::lock_guard<StaticMutex>& lock, MediumLargeLine* line, unsigned char count)
+{
+    if (!line->deref(count))
+        return;
+    deallocateMediumLargeLine(lock, line);
+}
+
 } // namespace bmalloc
 
 #endif // Heap_h
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#ifndef HugePage_h
+#define HugePage_h
+
+#include "BAssert.h"
+#include "Sizes.h"
+#include <array>
+#include <cstdint>
+
+namespace bmalloc {
+
+// Tracks the pages of one hugePageSize region of a small, medium or
+// medium-large chunk, for the VMHeap's hugepage mode. All functions require
+// the VMHeap's lock.
+//
+// A region is backed once we hand out one of its pages, and stays backed
+// until all of its pages are free and we release it to the OS as a whole.
+
+class HugePage {
+public:
+    static const size_t maxPageCount = hugePageSize / vmPageSize;
+
+    // Pages in the region, not counting chunk metadata.
+    size_t pageCount() { return m_pageCount; }
+    size_t freePageCount() { return m_freePageCount; }
+    bool isFree() { return m_freePageCount == m_pageCount; }
+
+    bool isBacked() { return m_isBacked; }
+    void setBacked(bool isBacked) { m_isBacked = isBacked; }
+
+    // Whether we may release the region to the OS, which we can't do for
+    // huge TLB pages.
+    bool isReleasable() { return m_isReleasable; }
+    void setReleasable(bool isReleasable) { m_isReleasable = isReleasable; }
+
+    // Links for the HugePageSet list the region is in.
+    HugePage* previous() { return m_previous; }
+    void setPrevious(HugePage* previous) { m_previous = previous; }
+    HugePage* next() { return m_next; }
+    void setNext(HugePage* next) { m_next = next; }
+
+    // When the region's last page became free, in decayClock() time.
+    unsigned freeTime() { return m_freeTime; }
+    void setFreeTime(unsigned freeTime) { m_freeTime = freeTime; }
+
+    // Page indices are relative to the start of the region.
+    void addPage(size_t index);
+    void freePage(size_t index);
+    size_t takeFreePage();
+
+private:
+    static const size_t wordBits = 64;
+
+    std::array<uint64_t, (maxPageCount + wordBits - 1) / wordBits> m_freePages;
+    unsigned short m_pageCount;
+    unsigned short m_freePageCount;
+    bool m_isBacked;
+    bool m_isReleasable;
+    unsigned m_freeTime;
+    HugePage* m_previous;
+    HugePage* m_next;
+};
+
+inline void HugePage::addPage(size_t index)
+{
+    ++m_pageCount;
+    freePage(index);
+}
+
+inline void HugePage::freePage(size_t index)
+{
+    BASSERT(index < maxPageCount);
+    BASSERT(!(m_freePages[index / wordBits] & (1ull << (index % wordBits))));
+    m_freePages[index / wordBits] |= 1ull << (index % wordBits);
+    ++m_freePageCount;
+}
+
+inline size_t HugePage::takeFreePage()
+{
+    BASSERT(m_freePageCount);
+
+    // Taking the lowest free page keeps the rest of the region in long runs.
+    for (size_t word = 0; word < m_freePages.size(); ++word) {
+        if (!m_freePages[word])
+            continue;
+
+        size_t bit = __builtin_ctzll(m_freePages[word]);
+        m_freePages[word] &= m_freePages[word] - 1;
+        --m_freePageCount;
+        return word * wordBits + bit;
+    }
+
+    RELEASE_BASSERT(false);
+    return 0;
+}
+
+// How densely the VMHeap packs pages into huge pages. The fraction of backed
+// memory in use is usedBytes / (usedBytes + freeBytes).
+struct HugePageStatistics {
+    size_t hugePageCount; // Regions in small, medium and medium-large chunks.
+    size_t backedHugePageCount;
+    size_t usedBytes; // Pages handed out to the Heap.
+    size_t freeBytes; // Free pages in backed regions.
+};
+
+} // namespace bmalloc
+
+#endif // HugePage_h
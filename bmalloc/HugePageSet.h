@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#ifndef HugePageSet_h
+#define HugePageSet_h
+
+#include "Decay.h"
+#include "HugePage.h"
+#include <array>
+#include <chrono>
+
+namespace bmalloc {
+
+// The huge pages of one page type that have free pages, for the VMHeap's
+// hugepage mode. Picking a huge page to allocate from or to release takes
+// constant time. All functions require the VMHeap's lock.
+//
+// Backed huge pages in use are bucketed by how many free pages they have.
+// Backed huge pages whose pages are all free are in the order they became
+// free, so the idle ones come first. Full huge pages aren't in the set.
+
+class HugePageSet {
+public:
+    HugePageSet();
+
+    // Adds a huge page that isn't backed yet.
+    void add(HugePage*);
+
+    // Returns the huge page to allocate from next: the fullest backed one
+    // that has a free page, else the most recently freed one, else one that
+    // isn't backed yet. Returns null if no huge page has a free page.
+    HugePage* fullest();
+
+    // Takes the lowest free page, and backs the huge page if it wasn't
+    // already. Returns the page's index in the huge page.
+    size_t takeFreePage(HugePage*);
+    void freePage(HugePage*, size_t index, unsigned now);
+
+    // Removes and returns the free huge page that has been free the longest,
+    // if it has been free for at least idleTime. Add it back once released.
+    HugePage* takeIdleHugePage(unsigned now, std::chrono::milliseconds idleTime);
+    bool hasFreeHugePages() { return !!m_free.head; }
+
+private:
+    static const size_t wordBits = 64;
+
+    struct List {
+        HugePage* head;
+        HugePage* tail;
+    };
+
+    List& list(HugePage*);
+    void insert(HugePage*);
+    void remove(HugePage*);
+
+    // m_buckets[i] holds backed huge pages with i free pages, and bit i of
+    // m_nonEmptyBuckets is set when it's not empty.
+    std::array<List, HugePage::maxPageCount + 1> m_buckets;
+    std::array<uint64_t, (HugePage::maxPageCount + wordBits) / wordBits> m_nonEmptyBuckets;
+    List m_free;
+    List m_unbacked;
+};
+
+inline HugePageSet::HugePageSet()
+    : m_buckets()
+    , m_nonEmptyBuckets()
+    , m_free()
+    , m_unbacked()
+{
+}
+
+inline HugePageSet::List& HugePageSet::list(HugePage* hugePage)
+{
+    if (!hugePage->isBacked())
+        return m_unbacked;
+
+    // We can't release huge TLB pages, so they stay in their bucket.
+    if (hugePage->isFree() && hugePage->isReleasable())
+        return m_free;
+
+    return m_buckets[hugePage->freePageCount()];
+}
+
+inline void HugePageSet::insert(HugePage* hugePage)
+{
+    BASSERT(hugePage->freePageCount());
+
+    List& list = this->list(hugePage);
+    hugePage->setPrevious(list.tail);
+    hugePage->setNext(nullptr);
+    if (list.tail)
+        list.tail->setNext(hugePage);
+    else
+        list.head = hugePage;
+    list.tail = hugePage;
+
+    if (&list != &m_free && &list != &m_unbacked) {
+        size_t bucket = &list - m_buckets.data();
+        m_nonEmptyBuckets[bucket / wordBits] |= 1ull << (bucket % wordBits);
+    }
+}
+
+inline void HugePageSet::remove(HugePage* hugePage)
+{
+    List& list = this->list(hugePage);
+    if (hugePage->previous())
+        hugePage->previous()->setNext(hugePage->next());
+    else
+        list.head = hugePage->next();
+    if (hugePage->next())
+        hugePage->next()->setPrevious(hugePage->previous());
+    else
+        list.tail = hugePage->previous();
+
+    if (!list.head && &list != &m_free && &list != &m_unbacked) {
+        size_t bucket = &list - m_buckets.data();
+        m_nonEmptyBuckets[bucket / wordBits] &= ~(1ull << (bucket % wordBits));
+    }
+}
+
+inline void HugePageSet::add(HugePage* hugePage)
+{
+    BASSERT(!hugePage->isBacked());
+    insert(hugePage);
+}
+
+inline HugePage* HugePageSet::fullest()
+{
+    for (size_t word = 0; word < m_nonEmptyBuckets.size(); ++word) {
+        if (!m_nonEmptyBuckets[word])
+            continue;
+        size_t bucket = word * wordBits + __builtin_ctzll(m_nonEmptyBuckets[word]);
+        return m_buckets[bucket].head;
+    }
+
+    // The most recently freed huge page is the least likely to be released.
+    if (m_free.tail)
+        return m_free.tail;
+
+    return m_unbacked.head;
+}
+
+inline size_t HugePageSet::takeFreePage(HugePage* hugePage)
+{
+    remove(hugePage);
+    hugePage->setBacked(true);
+    size_t index = hugePage->takeFreePage();
+    if (hugePage->freePageCount())
+        insert(hugePage);
+    return index;
+}
+
+inline void HugePageSet::freePage(HugePage* hugePage, size_t index, unsigned now)
+{
+    BASSERT(hugePage->isBacked());
+
+    if (hugePage->freePageCount())
+        remove(hugePage);
+    hugePage->freePage(index);
+    if (hugePage->isFree())
+        hugePage->setFreeTime(now);
+    insert(hugePage);
+}
+
+inline HugePage* HugePageSet::takeIdleHugePage(unsigned now, std::chrono::milliseconds idleTime)
+{
+    HugePage* hugePage = m_free.head;
+    if (!hugePage || decayAge(now, hugePage->freeTime()) < idleTime)
+        return nullptr;
+
+    remove(hugePage);
+    return hugePage;
+}
+
+} // namespace bmalloc
+
+#endif // HugePageSet_h
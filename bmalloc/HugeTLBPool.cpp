@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#include "Environment.h"
+#include "HugeTLBPool.h"
+#include "VMAllocate.h"
+
+namespace bmalloc {
+
+HugeTLBPool::HugeTLBPool(std::lock_guard<StaticMutex>&)
+    : m_usedBytes(0)
+{
+    Environment environment;
+    m_poolSize = environment.hugeTLBPoolSize();
+    m_pageSize = environment.hugeTLBPageSize();
+}
+
+HugeTLBPool::HugeTLBPool(size_t poolSize, size_t pageSize)
+    : m_poolSize(poolSize)
+    , m_pageSize(pageSize)
+    , m_usedBytes(0)
+{
+    BASSERT(isPowerOfTwo(pageSize));
+}
+
+Range HugeTLBPool::tryAllocate(size_t alignment, size_t size)
+{
+    if (!m_poolSize)
+        return Range();
+
+    size_t vmSize = roundUpToMultipleOf(m_pageSize, size);
+    if (vmSize - size > size / 8)
+        return Range();
+
+    size_t usedBytes = m_usedBytes.load(std::memory_order_relaxed);
+    do {
+        if (vmSize > m_poolSize - usedBytes)
+            return Range();
+    } while (!m_usedBytes.compare_exchange_weak(usedBytes, usedBytes + vmSize, std::memory_order_relaxed));
+
+    void* result = tryVMAllocateHugeTLB(max(alignment, m_pageSize), vmSize, m_pageSize);
+    if (!result) {
+        m_usedBytes.fetch_sub(vmSize, std::memory_order_relaxed);
+        return Range();
+    }
+
+    return Range(result, vmSize);
+}
+
+void HugeTLBPool::deallocate(const Range& range)
+{
+    BASSERT(!(range.size() % m_pageSize));
+
+    vmDeallocate(range.begin(), range.size());
+    m_usedBytes.fetch_sub(range.size(), std::memory_order_relaxed);
+}
+
+} // namespace bmalloc
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#ifndef HugeTLBPool_h
+#define HugeTLBPool_h
+
+#include "Range.h"
+#include "StaticMutex.h"
+#include <atomic>
+#include <mutex>
+
+namespace bmalloc {
+
+// Maps memory from the huge pages that some hosts reserve for their
+// processes (MAP_HUGETLB), when transparent huge pages aren't available.
+// BMALLOC_HUGETLB_POOL_SIZE caps how many bytes we map this way, and
+// BMALLOC_HUGETLB_PAGE_SIZE picks the page size, 2MB by default. Callers fall
+// back to normal pages when the pool can't serve them.
+//
+// The OS can only release a huge page mapping as a whole, so the scavenger
+// leaves this memory alone. After fork(), the OS copies huge pages on write,
+// and kills the child if it has no huge pages left to copy to, so processes
+// that fork need a pool size well under the host's reservation.
+
+class HugeTLBPool {
+public:
+    HugeTLBPool(std::lock_guard<StaticMutex>&);
+    HugeTLBPool(size_t poolSize, size_t pageSize);
+
+    size_t poolSize() { return m_poolSize; }
+    size_t pageSize() { return m_pageSize; }
+    size_t usedBytes() { return m_usedBytes.load(std::memory_order_relaxed); }
+
+    // Maps size bytes, rounded up to a whole number of huge pages, at the
+    // given alignment. Returns an empty range if the pool is off or used up,
+    // if rounding up would waste more than an eighth of size, or if the OS
+    // has no huge pages left.
+    Range tryAllocate(size_t alignment, size_t size);
+    void deallocate(const Range&);
+
+private:
+    size_t m_poolSize;
+    size_t m_pageSize;
+    std::atomic<size_t> m_usedBytes;
+};
+
+} // namespace bmalloc
+
+#endif // HugeTLBPool_h
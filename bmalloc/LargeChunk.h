@@ -42,6 +42,13 @@ public:
     static BeginTag* beginTag(void*);
     static EndTag* endTag(void*, size_t);
 
+    LargeChunk(size_t shard, bool isHugeTLB);
+
+    size_t shard() { return m_shard; }
+
+    // Whether we mapped the chunk from the HugeTLBPool.
+    bool isHugeTLB() { return m_isHugeTLB; }
+
     char* begin() { return m_memory; }
     char* end() { return reinterpret_cast<char*>(this) + largeChunkSize; }
 
@@ -64,6 +71,8 @@ private:
     // We use the X's for boundary tags and the O's for edge sentinels.
 
     BoundaryTag m_boundaryTags[boundaryTagCount];
+    unsigned m_shard;
+    bool m_isHugeTLB;
 
     // Align to vmPageSize to avoid sharing physical pages with metadata.
     // Otherwise, we'll confuse the scavenger into trying to scavenge metadata.
@@ -78,6 +87,12 @@ private:
 #endif
 };
 
+inline LargeChunk::LargeChunk(size_t shard, bool isHugeTLB)
+    : m_shard(shard)
+    , m_isHugeTLB(isHugeTLB)
+{
+}
+
 inline LargeChunk* LargeChunk::get(void* object)
 {
     BASSERT(!isSmallOrMedium(object));
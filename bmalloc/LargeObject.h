@@ -65,6 +65,10 @@ public:
     LargeObject merge() const;
     std::pair<LargeObject, LargeObject> split(size_t) const;
 
+    // Absorbs our right neighbor, if it's free, has our owner, and would
+    // bring us to at least the provided size. Returns LargeObject() otherwise.
+    LargeObject extend(size_t) const;
+
 private:
     LargeObject(BeginTag*, EndTag*, void*);
 
@@ -204,6 +208,34 @@ inline LargeObject LargeObject::merge() const
     return LargeObject(beginTag, endTag, range.begin());
 }
 
+inline LargeObject LargeObject::extend(size_t size) const
+{
+    validate();
+    BASSERT(!isFree());
+
+    BeginTag* beginTag = m_beginTag;
+    EndTag* endTag = m_endTag;
+    Owner owner = this->owner();
+
+    BeginTag* next = endTag->next();
+    if (!next->isFree() || next->owner() != owner || this->size() + next->size() < size)
+        return LargeObject();
+
+    Range range(begin(), this->size() + next->size());
+
+    endTag->clear();
+    next->clear();
+
+    endTag = LargeChunk::endTag(range.begin(), range.size());
+
+    beginTag->setRange(range);
+    beginTag->setFree(false);
+    beginTag->setOwner(owner);
+    endTag->init(beginTag);
+
+    return LargeObject(beginTag, endTag, range.begin());
+}
+
 inline std::pair<LargeObject, LargeObject> LargeObject::split(size_t size) const
 {
     Range split(begin(), size);
@@ -29,6 +29,7 @@
 #include "BAssert.h"
 #include "Mutex.h"
 #include "ObjectType.h"
+#include <atomic>
 #include <mutex>
 
 namespace bmalloc {
@@ -46,15 +47,19 @@ public:
 
     static Line* get(void*);
 
-    void ref(std::lock_guard<StaticMutex>&, unsigned char);
-    bool deref(std::lock_guard<StaticMutex>&);
-    unsigned refCount(std::lock_guard<StaticMutex>&) { return m_refCount; }
+    // A line only goes from free to referenced, or from referenced to free,
+    // under the Heap's lock for the size class of this line's page. Other
+    // references can be dropped without the lock, using tryDeref().
+    void ref(unsigned char);
+    bool tryDeref(unsigned char = 1);
+    bool deref(unsigned char = 1);
+    unsigned refCount() { return m_refCount.load(std::memory_order_relaxed); }
     
     char* begin();
     char* end();
 
 private:
-    unsigned char m_refCount;
+    std::atomic<unsigned char> m_refCount;
 };
 
 template<class Traits>
@@ -82,19 +87,32 @@ inline char* Line<Traits>::end()
 }
 
 template<class Traits>
-inline void Line<Traits>::ref(std::lock_guard<StaticMutex>&, unsigned char refCount)
+inline void Line<Traits>::ref(unsigned char refCount)
 {
-    BASSERT(!m_refCount);
+    BASSERT(!this->refCount());
     BASSERT(refCount <= maxRefCount);
-    m_refCount = refCount;
+    m_refCount.store(refCount, std::memory_order_relaxed);
 }
 
+// Returns false, without dropping the references, if they're the last ones.
 template<class Traits>
-inline bool Line<Traits>::deref(std::lock_guard<StaticMutex>&)
+inline bool Line<Traits>::tryDeref(unsigned char count)
 {
-    BASSERT(m_refCount);
-    --m_refCount;
-    return !m_refCount;
+    unsigned char refCount = m_refCount.load(std::memory_order_relaxed);
+    do {
+        BASSERT(refCount >= count);
+        if (refCount == count)
+            return false;
+    } while (!m_refCount.compare_exchange_weak(refCount, refCount - count, std::memory_order_acq_rel, std::memory_order_relaxed));
+    return true;
+}
+
+template<class Traits>
+inline bool Line<Traits>::deref(unsigned char count)
+{
+    unsigned char refCount = m_refCount.fetch_sub(count, std::memory_order_acq_rel);
+    BASSERT(refCount >= count);
+    return refCount == count;
 }
 
 } // namespace bmalloc
@@ -0,0 +1,460 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+// Replaces the system malloc and the C++ allocation operators with bmalloc,
+// for use with LD_PRELOAD. This file is only part of the shared library.
+
+#include "BootstrapArena.h"
+#include "bmalloc.h"
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#define EXPORT __attribute__((visibility("default")))
+
+using namespace bmalloc;
+
+// Until our constructor runs, the dynamic loader and libc may call us before
+// it's safe to use bmalloc, so those calls go to the bootstrap arena.
+static bool s_isInitialized;
+
+// Set while this thread is inside bmalloc. Code that bmalloc calls into, like
+// pthread_create, may allocate while bmalloc holds its own locks, so those
+// allocations go to the bootstrap arena too.
+static thread_local bool t_isInBmalloc;
+
+// Frees that arrive while this thread is inside bmalloc, chained through their
+// first word. bmalloc may hold the locks they'd need, so the outermost
+// BmallocScope frees them on the way out.
+static thread_local void* t_deferredFrees;
+
+__attribute__((constructor)) static void initialize()
+{
+    s_isInitialized = true;
+}
+
+namespace {
+
+class BmallocScope {
+public:
+    BmallocScope()
+        : m_wasInBmalloc(t_isInBmalloc)
+    {
+        t_isInBmalloc = true;
+    }
+
+    ~BmallocScope()
+    {
+        if (!m_wasInBmalloc) {
+            // Freeing may defer more frees, which this loop picks up too.
+            while (void* object = t_deferredFrees) {
+                t_deferredFrees = *static_cast<void**>(object);
+                api::free(object);
+            }
+        }
+        t_isInBmalloc = m_wasInBmalloc;
+    }
+
+private:
+    bool m_wasInBmalloc;
+};
+
+} // namespace
+
+static inline bool canUseBmalloc()
+{
+    return s_isInitialized && !t_isInBmalloc;
+}
+
+// Larger sizes would overflow when we round them up.
+static const size_t maxSize = std::numeric_limits<ptrdiff_t>::max();
+
+// malloc must return memory aligned for any fundamental type. Objects of a
+// size class that's a multiple of 16 are 16-byte aligned, and an object of at
+// most 8 bytes can't hold a type that needs more than 8.
+static const size_t mallocAlignment = 16;
+
+static inline size_t mallocSize(size_t size)
+{
+    if (size <= Sizes::alignment)
+        return max(size, static_cast<size_t>(1));
+    return roundUpToMultipleOf<mallocAlignment>(size);
+}
+
+static inline void* allocate(size_t size)
+{
+    if (size > maxSize)
+        return nullptr;
+
+    if (!canUseBmalloc())
+        return BootstrapArena::allocate(mallocAlignment, size);
+
+    BmallocScope scope;
+    return api::tryMalloc(mallocSize(size));
+}
+
+static inline void* allocate(size_t alignment, size_t size)
+{
+    BASSERT(isPowerOfTwo(alignment));
+    if (size > maxSize || alignment > maxSize)
+        return nullptr;
+
+    if (!canUseBmalloc())
+        return BootstrapArena::allocate(alignment, size);
+
+    BmallocScope scope;
+    return api::tryMemalign(alignment, mallocSize(size));
+}
+
+static inline void deferFree(void* object)
+{
+    static_assert(Sizes::alignment >= sizeof(void*), "every bmalloc object must have room for the link");
+    *static_cast<void**>(object) = t_deferredFrees;
+    t_deferredFrees = object;
+}
+
+static inline void deallocate(void* object)
+{
+    if (!object)
+        return;
+
+    if (BootstrapArena::contains(object))
+        return BootstrapArena::deallocate(object);
+
+    if (t_isInBmalloc)
+        return deferFree(object);
+
+    BmallocScope scope;
+    api::free(object);
+}
+
+// Only valid for objects from allocate(size).
+static inline void deallocate(void* object, size_t size)
+{
+    if (!object)
+        return;
+
+    if (BootstrapArena::contains(object))
+        return BootstrapArena::deallocate(object);
+
+    if (t_isInBmalloc)
+        return deferFree(object);
+
+    BmallocScope scope;
+    api::freeSized(object, mallocSize(size));
+}
+
+static inline size_t usableSize(void* object)
+{
+    if (!object)
+        return 0;
+
+    if (BootstrapArena::contains(object))
+        return BootstrapArena::usableSize(object);
+
+    BmallocScope scope;
+    return api::usableSize(object);
+}
+
+static inline void* setErrno(void* result)
+{
+    if (!result)
+        errno = ENOMEM;
+    return result;
+}
+
+extern "C" {
+
+EXPORT void* malloc(size_t);
+EXPORT void free(void*);
+EXPORT void* calloc(size_t, size_t);
+EXPORT void* realloc(void*, size_t);
+EXPORT int posix_memalign(void**, size_t, size_t);
+EXPORT void* aligned_alloc(size_t, size_t);
+EXPORT void* memalign(size_t, size_t);
+EXPORT void* valloc(size_t);
+EXPORT void* pvalloc(size_t);
+EXPORT size_t malloc_usable_size(void*);
+
+void* malloc(size_t size)
+{
+    return setErrno(allocate(size));
+}
+
+void free(void* object)
+{
+    deallocate(object);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    if (size && count > maxSize / size)
+        return setErrno(nullptr);
+    size *= count;
+
+    if (!canUseBmalloc()) {
+        void* result = BootstrapArena::allocate(mallocAlignment, size);
+        if (result)
+            memset(result, 0, size);
+        return setErrno(result);
+    }
+
+    // XLarge objects are freshly mapped, so they're zero already, and
+    // tryMalloc lets us report failure instead of crashing.
+    if (size > largeMax)
+        return setErrno(allocate(size));
+
+    BmallocScope scope;
+    return api::calloc(1, mallocSize(size));
+}
+
+void* realloc(void* object, size_t newSize)
+{
+    if (!object)
+        return malloc(newSize);
+
+    // Like glibc, we free the object and return null.
+    if (!newSize) {
+        deallocate(object);
+        return nullptr;
+    }
+
+    if (newSize > maxSize)
+        return setErrno(nullptr);
+
+    if (canUseBmalloc() && !BootstrapArena::contains(object)) {
+        BmallocScope scope;
+        return api::realloc(object, mallocSize(newSize));
+    }
+
+    void* result = allocate(newSize);
+    if (!result)
+        return setErrno(nullptr);
+    memcpy(result, object, min(newSize, usableSize(object)));
+    deallocate(object);
+    return result;
+}
+
+int posix_memalign(void** result, size_t alignment, size_t size)
+{
+    if (!isPowerOfTwo(alignment) || alignment % sizeof(void*))
+        return EINVAL;
+
+    void* object = allocate(alignment, size);
+    if (!object)
+        return ENOMEM;
+
+    *result = object;
+    return 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    if (!isPowerOfTwo(alignment)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    return setErrno(allocate(alignment, size));
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    // Like glibc, we round the alignment up to a power of two.
+    size_t powerOfTwoAlignment = 1;
+    while (powerOfTwoAlignment < alignment) {
+        powerOfTwoAlignment *= 2;
+        if (!powerOfTwoAlignment)
+            return setErrno(nullptr);
+    }
+
+    return setErrno(allocate(powerOfTwoAlignment, size));
+}
+
+void* valloc(size_t size)
+{
+    return setErrno(allocate(vmPageSize, size));
+}
+
+void* pvalloc(size_t size)
+{
+    if (size > maxSize)
+        return setErrno(nullptr);
+    return setErrno(allocate(vmPageSize, roundUpToMultipleOf<vmPageSize>(max(size, static_cast<size_t>(1)))));
+}
+
+size_t malloc_usable_size(void* object)
+{
+    return usableSize(object);
+}
+
+} // extern "C"
+
+static void* allocateOrThrow(size_t size)
+{
+    while (1) {
+        if (void* result = allocate(size))
+            return result;
+
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+static void* allocateOrThrow(size_t alignment, size_t size)
+{
+    while (1) {
+        if (void* result = allocate(alignment, size))
+            return result;
+
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+static void* tryAllocate(size_t size) noexcept
+{
+    try {
+        return allocateOrThrow(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+static void* tryAllocate(size_t alignment, size_t size) noexcept
+{
+    try {
+        return allocateOrThrow(alignment, size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+EXPORT void* operator new(size_t size)
+{
+    return allocateOrThrow(size);
+}
+
+EXPORT void* operator new[](size_t size)
+{
+    return allocateOrThrow(size);
+}
+
+EXPORT void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return tryAllocate(size);
+}
+
+EXPORT void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return tryAllocate(size);
+}
+
+EXPORT void* operator new(size_t size, std::align_val_t alignment)
+{
+    return allocateOrThrow(static_cast<size_t>(alignment), size);
+}
+
+EXPORT void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return allocateOrThrow(static_cast<size_t>(alignment), size);
+}
+
+EXPORT void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return tryAllocate(static_cast<size_t>(alignment), size);
+}
+
+EXPORT void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return tryAllocate(static_cast<size_t>(alignment), size);
+}
+
+EXPORT void operator delete(void* object) noexcept
+{
+    deallocate(object);
+}
+
+EXPORT void operator delete[](void* object) noexcept
+{
+    deallocate(object);
+}
+
+EXPORT void operator delete(void* object, const std::nothrow_t&) noexcept
+{
+    deallocate(object);
+}
+
+EXPORT void operator delete[](void* object, const std::nothrow_t&) noexcept
+{
+    deallocate(object);
+}
+
+EXPORT void operator delete(void* object, size_t size) noexcept
+{
+    deallocate(object, size);
+}
+
+EXPORT void operator delete[](void* object, size_t size) noexcept
+{
+    deallocate(object, size);
+}
+
+// Aligned objects can have any type at any size, so we can't free them by size.
+
+EXPORT void operator delete(void* object, std::align_val_t) noexcept
+{
+    deallocate(object);
+}
+
+EXPORT void operator delete[](void* object, std::align_val_t) noexcept
+{
+    deallocate(object);
+}
+
+EXPORT void operator delete(void* object, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    deallocate(object);
+}
+
+EXPORT void operator delete[](void* object, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    deallocate(object);
+}
+
+EXPORT void operator delete(void* object, size_t, std::align_val_t) noexcept
+{
+    deallocate(object);
+}
+
+EXPORT void operator delete[](void* object, size_t, std::align_val_t) noexcept
+{
+    deallocate(object);
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#ifndef Map_h
+#define Map_h
+
+#include "Algorithm.h"
+#include "BAssert.h"
+#include "Inline.h"
+#include "VMAllocate.h"
+#include <cstddef>
+#include <type_traits>
+
+namespace bmalloc {
+
+// An open addressing hash table that allocates using vmAllocate instead of
+// malloc, and grows and shrinks automatically. Hash::hash(key) computes a
+// key's hash. An all-zero key, like null, marks an empty bucket, so it can't
+// be added.
+
+template<typename Key, typename Value, typename Hash>
+class Map {
+    static_assert(std::is_trivially_destructible<Key>::value, "Map must have a trivial destructor.");
+    static_assert(std::is_trivially_destructible<Value>::value, "Map must have a trivial destructor.");
+public:
+    struct Bucket {
+        Key key;
+        Value value;
+    };
+
+    Map(const Map&) = delete;
+    Map& operator=(const Map&) = delete;
+
+    Map();
+    ~Map();
+
+    size_t size() { return m_keyCount; }
+    size_t capacity() { return m_capacity; }
+
+    // Returns null if the key isn't in the map. Changing the map invalidates
+    // the result.
+    Value* find(const Key&);
+
+    // The key must not already be in the map.
+    void add(const Key&, const Value&);
+
+    // The key must be in the map.
+    Value take(const Key&);
+
+private:
+    static const size_t minCapacity = 64;
+    static const size_t maxLoadFactor = 2; // Grow when more than 1 / 2 full.
+    static const size_t minLoadFactor = 8; // Shrink when less than 1 / 8 full.
+
+    size_t index(const Key& key) { return Hash::hash(key) & (m_capacity - 1); }
+    size_t next(size_t i) { return (i + 1) & (m_capacity - 1); }
+    bool isEmpty(const Bucket& bucket) { return bucket.key == Key(); }
+
+    Bucket* findBucket(const Key&);
+
+    void rehash(size_t newCapacity);
+
+    Bucket* m_table;
+    size_t m_keyCount;
+    size_t m_capacity;
+};
+
+template<typename Key, typename Value, typename Hash>
+inline Map<Key, Value, Hash>::Map()
+    : m_table(nullptr)
+    , m_keyCount(0)
+    , m_capacity(0)
+{
+}
+
+template<typename Key, typename Value, typename Hash>
+Map<Key, Value, Hash>::~Map()
+{
+    if (m_table)
+        vmDeallocate(m_table, vmSize(m_capacity * sizeof(Bucket)));
+}
+
+template<typename Key, typename Value, typename Hash>
+inline auto Map<Key, Value, Hash>::findBucket(const Key& key) -> Bucket*
+{
+    BASSERT(!(key == Key()));
+    if (!m_capacity)
+        return nullptr;
+
+    for (size_t i = index(key); !isEmpty(m_table[i]); i = next(i)) {
+        if (m_table[i].key == key)
+            return &m_table[i];
+    }
+    return nullptr;
+}
+
+template<typename Key, typename Value, typename Hash>
+inline Value* Map<Key, Value, Hash>::find(const Key& key)
+{
+    Bucket* bucket = findBucket(key);
+    if (!bucket)
+        return nullptr;
+    return &bucket->value;
+}
+
+template<typename Key, typename Value, typename Hash>
+inline void Map<Key, Value, Hash>::add(const Key& key, const Value& value)
+{
+    BASSERT(!(key == Key()));
+    BASSERT(!find(key));
+
+    if ((m_keyCount + 1) * maxLoadFactor > m_capacity)
+        rehash(max(minCapacity, m_capacity * 2));
+
+    size_t i = index(key);
+    while (!isEmpty(m_table[i]))
+        i = next(i);
+    m_table[i] = { key, value };
+    ++m_keyCount;
+}
+
+template<typename Key, typename Value, typename Hash>
+inline Value Map<Key, Value, Hash>::take(const Key& key)
+{
+    Bucket* bucket = findBucket(key);
+    RELEASE_BASSERT(bucket);
+    Value result = bucket->value;
+
+    // Shift later buckets in the probe sequence back, so lookups never stop
+    // at the hole early.
+    size_t hole = bucket - m_table;
+    for (size_t i = next(hole); !isEmpty(m_table[i]); i = next(i)) {
+        size_t home = index(m_table[i].key);
+        bool isBetween = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (isBetween)
+            continue;
+        m_table[hole] = m_table[i];
+        hole = i;
+    }
+    m_table[hole] = Bucket();
+    --m_keyCount;
+
+    if (m_capacity > minCapacity && m_keyCount * minLoadFactor < m_capacity)
+        rehash(m_capacity / 2);
+    return result;
+}
+
+template<typename Key, typename Value, typename Hash>
+NO_INLINE void Map<Key, Value, Hash>::rehash(size_t newCapacity)
+{
+    static_assert(!(minCapacity & (minCapacity - 1)), "Map capacity must be a power of two.");
+
+    Bucket* oldTable = m_table;
+    size_t oldCapacity = m_capacity;
+
+    // vmAllocate zero-fills, which marks every bucket empty.
+    m_table = static_cast<Bucket*>(vmAllocate(vmSize(newCapacity * sizeof(Bucket))));
+    m_capacity = newCapacity;
+    m_keyCount = 0;
+
+    if (!oldTable)
+        return;
+
+    for (size_t i = 0; i < oldCapacity; ++i) {
+        if (!isEmpty(oldTable[i]))
+            add(oldTable[i].key, oldTable[i].value);
+    }
+    vmDeallocate(oldTable, vmSize(oldCapacity * sizeof(Bucket)));
+}
+
+} // namespace bmalloc
+
+#endif // Map_h
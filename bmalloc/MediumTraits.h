@@ -41,6 +41,7 @@ struct MediumTraits {
     typedef Page<MediumTraits> PageType;
 
     static const size_t lineSize = mediumLineSize;
+    static const size_t pageSize = vmPageSize;
     static const size_t minimumObjectSize = smallMax + alignment;
     static const size_t chunkSize = mediumChunkSize;
     static const size_t chunkOffset = mediumChunkOffset;
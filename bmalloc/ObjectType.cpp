@@ -33,6 +33,8 @@ ObjectType objectType(void* object)
     if (isSmallOrMedium(object)) {
         if (isSmall(object))
             return Small;
+        if (isMediumLarge(object))
+            return MediumLarge;
         return Medium;
     }
     
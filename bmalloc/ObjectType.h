@@ -31,24 +31,32 @@
 
 namespace bmalloc {
 
-enum ObjectType { Small, Medium, Large, XLarge };
+enum ObjectType { Small, Medium, MediumLarge, Large, XLarge };
 
 ObjectType objectType(void*);
 
+// Medium-large objects count as medium here: like small and medium objects,
+// they live in lines and pages, and are freed through the object log.
 inline bool isSmallOrMedium(void* object)
 {
     return test(object, smallOrMediumTypeMask);
 }
 
+inline bool isMediumLarge(void* smallOrMedium)
+{
+    BASSERT(isSmallOrMedium(smallOrMedium));
+    return !test(smallOrMedium, smallOrMediumMediumLargeTypeMask);
+}
+
 inline bool isSmall(void* smallOrMedium)
 {
     BASSERT(isSmallOrMedium(smallOrMedium));
-    return test(smallOrMedium, smallOrMediumSmallTypeMask);
+    return !isMediumLarge(smallOrMedium) && test(smallOrMedium, smallOrMediumSmallTypeMask);
 }
 
 inline bool isMedium(void* smallOrMedium)
 {
-    return !isSmall(smallOrMedium);
+    return !isSmall(smallOrMedium) && !isMediumLarge(smallOrMedium);
 }
 
 inline bool isXLarge(void* object)
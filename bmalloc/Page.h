@@ -29,6 +29,7 @@
 #include "BAssert.h"
 #include "Mutex.h"
 #include "VMAllocate.h"
+#include <atomic>
 #include <mutex>
 
 namespace bmalloc {
@@ -40,41 +41,52 @@ public:
     typedef typename Traits::LineType Line;
 
     static const size_t lineSize = Traits::lineSize;
-    static const size_t lineCount = vmPageSize / lineSize;
+    static const size_t pageSize = Traits::pageSize;
+    static const size_t lineCount = pageSize / lineSize;
 
     static const unsigned char maxRefCount = std::numeric_limits<unsigned char>::max();
     static_assert(lineCount < maxRefCount, "maximum line count must fit in Page");
     
     static Page* get(Line*);
 
-    void ref(std::lock_guard<StaticMutex>&);
-    bool deref(std::lock_guard<StaticMutex>&);
-    unsigned refCount(std::lock_guard<StaticMutex>&) { return m_refCount; }
-    
+    // Changed under the Heap's lock for this page's size class. Atomic so the
+    // pages lock can check stale pages without holding that lock.
+    void ref();
+    bool deref();
+    unsigned refCount() { return m_refCount.load(std::memory_order_relaxed); }
+
+    // Guarded by the Heap's pages lock. Stable while the page has live objects.
     size_t sizeClass() { return m_sizeClass; }
     void setSizeClass(size_t sizeClass) { m_sizeClass = sizeClass; }
+
+    // Guarded by the lock of the Heap or VMHeap free list holding the page.
+    // When the page last became free, or was lazily freed to the VMHeap, in
+    // decayClock() time, so the scavenger can tell how long it's been idle.
+    unsigned freeTime() { return m_freeTime; }
+    void setFreeTime(unsigned freeTime) { m_freeTime = freeTime; }
     
     Line* begin();
     Line* end();
 
 private:
-    unsigned char m_refCount;
+    std::atomic<unsigned char> m_refCount;
     unsigned char m_sizeClass;
+    unsigned m_freeTime;
 };
 
 template<typename Traits>
-inline void Page<Traits>::ref(std::lock_guard<StaticMutex>&)
+inline void Page<Traits>::ref()
 {
-    BASSERT(m_refCount < maxRefCount);
-    ++m_refCount;
+    BASSERT(refCount() < maxRefCount);
+    m_refCount.fetch_add(1, std::memory_order_relaxed);
 }
 
 template<typename Traits>
-inline bool Page<Traits>::deref(std::lock_guard<StaticMutex>&)
+inline bool Page<Traits>::deref()
 {
-    BASSERT(m_refCount);
-    --m_refCount;
-    return !m_refCount;
+    unsigned char refCount = m_refCount.fetch_sub(1, std::memory_order_relaxed);
+    BASSERT(refCount);
+    return refCount == 1;
 }
 
 template<typename Traits>
@@ -82,7 +94,7 @@ inline auto Page<Traits>::get(Line* line) -> Page*
 {
     Chunk* chunk = Chunk::get(line);
     size_t lineNumber = line - chunk->lines();
-    size_t pageNumber = lineNumber * lineSize / vmPageSize;
+    size_t pageNumber = lineNumber * lineSize / pageSize;
     return &chunk->pages()[pageNumber];
 }
 
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#ifndef PerShard_h
+#define PerShard_h
+
+#include "Inline.h"
+#include "Sizes.h"
+#include "StaticMutex.h"
+#include <array>
+#include <mutex>
+
+namespace bmalloc {
+
+// Usage:
+//     Object* object = PerShard<Object>::get(shard);
+//     x = object->field->field;
+//
+// Like PerProcess, but with heapShardCount independent instances, each with
+// its own mutex. Each instance will be instantiated only once, even in the
+// face of concurrency, and is constructed with its shard index:
+//
+// Object(std::lock_guard<StaticMutex>&, size_t shard);
+
+template<typename T>
+class PerShard {
+public:
+    static T* get(size_t shard);
+    static T* getFastCase(size_t shard);
+
+    static StaticMutex& mutex(size_t shard) { return s_mutexes[shard]; }
+
+private:
+    static T* getSlowCase(size_t shard);
+
+    static std::array<std::atomic<T*>, heapShardCount> s_objects;
+    static std::array<StaticMutex, heapShardCount> s_mutexes;
+
+    typedef typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type Memory;
+    static std::array<Memory, heapShardCount> s_memory;
+};
+
+template<typename T>
+INLINE T* PerShard<T>::getFastCase(size_t shard)
+{
+    BASSERT(shard < heapShardCount);
+    return s_objects[shard].load(std::memory_order_consume);
+}
+
+template<typename T>
+INLINE T* PerShard<T>::get(size_t shard)
+{
+    T* object = getFastCase(shard);
+    if (!object)
+        return getSlowCase(shard);
+    return object;
+}
+
+template<typename T>
+NO_INLINE T* PerShard<T>::getSlowCase(size_t shard)
+{
+    std::lock_guard<StaticMutex> lock(s_mutexes[shard]);
+    if (!s_objects[shard].load(std::memory_order_consume)) {
+        T* t = new (&s_memory[shard]) T(lock, shard);
+        s_objects[shard].store(t, std::memory_order_release);
+    }
+    return s_objects[shard].load(std::memory_order_consume);
+}
+
+template<typename T>
+std::array<std::atomic<T*>, heapShardCount> PerShard<T>::s_objects;
+
+template<typename T>
+std::array<StaticMutex, heapShardCount> PerShard<T>::s_mutexes;
+
+template<typename T>
+std::array<typename PerShard<T>::Memory, heapShardCount> PerShard<T>::s_memory;
+
+} // namespace bmalloc
+
+#endif // PerShard_h
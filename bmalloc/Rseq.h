@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#ifndef Rseq_h
+#define Rseq_h
+
+#include "BPlatform.h"
+#include "Inline.h"
+#include <cstdint>
+
+#if BOS(LINUX) && BCPU(X86_64) && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#define HAVE_RSEQ 1
+#else
+#define HAVE_RSEQ 0
+#endif
+#else
+#define HAVE_RSEQ 0
+#endif
+
+#if HAVE_RSEQ
+
+namespace bmalloc {
+
+// Linux restartable sequences. Each primitive below is a critical section on
+// one CPU's data: it commits with a single final store, and if the thread is
+// preempted, migrated or signaled before that store, the kernel resumes it at
+// the section's abort handler instead. glibc registers a struct rseq for every
+// thread, and we piggyback on that registration.
+
+enum class RseqResult { Committed, Failed, Aborted };
+
+inline struct rseq* rseqArea()
+{
+    char* threadPointer;
+    __asm__ ("movq %%fs:0, %0" : "=r"(threadPointer));
+    return reinterpret_cast<struct rseq*>(threadPointer + __rseq_offset);
+}
+
+// Returns the current CPU, or -1 if this thread has no rseq registration.
+inline int rseqCurrentCPU()
+{
+    if (!__rseq_size)
+        return -1;
+    return static_cast<int>(*static_cast<volatile uint32_t*>(&rseqArea()->cpu_id));
+}
+
+#define RSEQ_STRINGIFY_IMPL(x) #x
+#define RSEQ_STRINGIFY(x) RSEQ_STRINGIFY_IMPL(x)
+
+// Opens a critical section that runs from label 1 to label 2. The rseq_cs
+// descriptor lives at label 3, and the abort handler, which must be preceded
+// by RSEQ_SIG, lives at label 4 and jumps to the "abort" C label. If we're not
+// running on the expected CPU, we abort right away. Both sections join the
+// enclosing function's COMDAT group ("?"), so they're discarded along with
+// duplicate copies of inline functions.
+#define RSEQ_CRITICAL_SECTION_BEGIN \
+    ".pushsection __rseq_cs, \"aw?\"\n\t" \
+    ".balign 32\n\t" \
+    "3:\n\t" \
+    ".long 0x0, 0x0\n\t" \
+    ".quad 1f, (2f - 1f), 4f\n\t" \
+    ".popsection\n\t" \
+    ".pushsection __rseq_failure, \"ax?\"\n\t" \
+    ".byte 0x0f, 0xb9, 0x3d\n\t" \
+    ".long " RSEQ_STRINGIFY(RSEQ_SIG) "\n\t" \
+    "4:\n\t" \
+    "jmp %l[abort]\n\t" \
+    ".popsection\n\t" \
+    "leaq 3b(%%rip), %%rax\n\t" \
+    "movq %%rax, %[rseqCS]\n\t" \
+    "1:\n\t" \
+    "cmpl %[cpu], %[currentCPU]\n\t" \
+    "jnz 4b\n\t"
+
+#define RSEQ_CRITICAL_SECTION_END \
+    "2:\n\t"
+
+#define RSEQ_CRITICAL_SECTION_INPUTS(rseq, cpu) \
+    [rseqCS] "m" ((rseq)->rseq_cs), [cpu] "r" (cpu), [currentCPU] "m" ((rseq)->cpu_id)
+
+// A bump word packs a bump allocation range into a single word, so it can be
+// updated with a single commit: bits [0, 48) hold the next object, and bits
+// [48, 64) hold the number of objects that remain.
+
+static const unsigned bumpWordCountShift = 48;
+static const uint64_t bumpWordPointerMask = (1ull << bumpWordCountShift) - 1;
+
+inline uint64_t makeBumpWord(char* begin, unsigned short objectCount)
+{
+    return reinterpret_cast<uint64_t>(begin) | static_cast<uint64_t>(objectCount) << bumpWordCountShift;
+}
+
+// Allocates one object of the given size from *word. Fails if *word is empty.
+INLINE RseqResult rseqBumpAllocate(int cpu, uint64_t* word, size_t size, void*& result)
+{
+    struct rseq* rseq = rseqArea();
+    uint64_t delta = static_cast<uint64_t>(size) - (1ull << bumpWordCountShift);
+    uint64_t oldWord;
+    __asm__ goto (
+        RSEQ_CRITICAL_SECTION_BEGIN
+        "movq %[word], %%rcx\n\t"
+        "movq %%rcx, %%rdx\n\t"
+        "shrq $48, %%rdx\n\t"
+        "jz %l[failed]\n\t"
+        "movq %%rcx, %[oldWord]\n\t"
+        "addq %[delta], %%rcx\n\t"
+        "movq %%rcx, %[word]\n\t"
+        RSEQ_CRITICAL_SECTION_END
+        :
+        : RSEQ_CRITICAL_SECTION_INPUTS(rseq, cpu),
+          [word] "m" (*word), [oldWord] "m" (oldWord), [delta] "r" (delta)
+        : "memory", "cc", "rax", "rcx", "rdx"
+        : abort, failed);
+    result = reinterpret_cast<void*>(oldWord & bumpWordPointerMask);
+    return RseqResult::Committed;
+abort:
+    return RseqResult::Aborted;
+failed:
+    return RseqResult::Failed;
+}
+
+// Replaces *word with newWord. Fails if *word still has objects remaining.
+inline RseqResult rseqBumpRefill(int cpu, uint64_t* word, uint64_t newWord)
+{
+    struct rseq* rseq = rseqArea();
+    __asm__ goto (
+        RSEQ_CRITICAL_SECTION_BEGIN
+        "movq %[word], %%rcx\n\t"
+        "shrq $48, %%rcx\n\t"
+        "jnz %l[failed]\n\t"
+        "movq %[newWord], %[word]\n\t"
+        RSEQ_CRITICAL_SECTION_END
+        :
+        : RSEQ_CRITICAL_SECTION_INPUTS(rseq, cpu),
+          [word] "m" (*word), [newWord] "r" (newWord)
+        : "memory", "cc", "rax", "rcx"
+        : abort, failed);
+    return RseqResult::Committed;
+abort:
+    return RseqResult::Aborted;
+failed:
+    return RseqResult::Failed;
+}
+
+// Empties *word, returning its old value.
+inline RseqResult rseqBumpTake(int cpu, uint64_t* word, uint64_t& oldWord)
+{
+    struct rseq* rseq = rseqArea();
+    __asm__ goto (
+        RSEQ_CRITICAL_SECTION_BEGIN
+        "movq %[word], %%rcx\n\t"
+        "movq %%rcx, %[oldWord]\n\t"
+        "movq $0, %[word]\n\t"
+        RSEQ_CRITICAL_SECTION_END
+        :
+        : RSEQ_CRITICAL_SECTION_INPUTS(rseq, cpu),
+          [word] "m" (*word), [oldWord] "m" (oldWord)
+        : "memory", "cc", "rax", "rcx"
+        : abort);
+    return RseqResult::Committed;
+abort:
+    return RseqResult::Aborted;
+}
+
+// Pushes object onto a stack of *size pointers. Fails if the stack is full.
+INLINE RseqResult rseqPush(int cpu, uint64_t* size, void** buffer, uint64_t capacity, void* object)
+{
+    struct rseq* rseq = rseqArea();
+    __asm__ goto (
+        RSEQ_CRITICAL_SECTION_BEGIN
+        "movq %[size], %%rcx\n\t"
+        "cmpq %[capacity], %%rcx\n\t"
+        "jae %l[failed]\n\t"
+        "movq %[object], (%[buffer], %%rcx, 8)\n\t"
+        "addq $1, %%rcx\n\t"
+        "movq %%rcx, %[size]\n\t"
+        RSEQ_CRITICAL_SECTION_END
+        :
+        : RSEQ_CRITICAL_SECTION_INPUTS(rseq, cpu),
+          [size] "m" (*size), [buffer] "r" (buffer), [capacity] "r" (capacity), [object] "r" (object)
+        : "memory", "cc", "rax", "rcx"
+        : abort, failed);
+    return RseqResult::Committed;
+abort:
+    return RseqResult::Aborted;
+failed:
+    return RseqResult::Failed;
+}
+
+// Pops an object from a stack of *size pointers. Fails if the stack is empty.
+inline RseqResult rseqPop(int cpu, uint64_t* size, void** buffer, void*& result)
+{
+    struct rseq* rseq = rseqArea();
+    void* object;
+    __asm__ goto (
+        RSEQ_CRITICAL_SECTION_BEGIN
+        "movq %[size], %%rcx\n\t"
+        "testq %%rcx, %%rcx\n\t"
+        "jz %l[failed]\n\t"
+        "subq $1, %%rcx\n\t"
+        "movq (%[buffer], %%rcx, 8), %%rdx\n\t"
+        "movq %%rdx, %[object]\n\t"
+        "movq %%rcx, %[size]\n\t"
+        RSEQ_CRITICAL_SECTION_END
+        :
+        : RSEQ_CRITICAL_SECTION_INPUTS(rseq, cpu),
+          [size] "m" (*size), [buffer] "r" (buffer), [object] "m" (object)
+        : "memory", "cc", "rax", "rcx", "rdx"
+        : abort, failed);
+    result = object;
+    return RseqResult::Committed;
+abort:
+    return RseqResult::Aborted;
+failed:
+    return RseqResult::Failed;
+}
+
+} // namespace bmalloc
+
+#endif // HAVE_RSEQ
+
+#endif // Rseq_h
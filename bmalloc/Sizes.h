@@ -59,18 +59,30 @@ namespace Sizes {
     static const size_t smallLineSize = 256;
     static const size_t smallLineMask = ~(smallLineSize - 1ul);
 
-    static const size_t smallChunkSize = superChunkSize / 4;
-    static const size_t smallChunkOffset = superChunkSize * 3 / 4;
+    static const size_t smallChunkSize = superChunkSize / 8;
+    static const size_t smallChunkOffset = superChunkSize * 7 / 8;
     static const size_t smallChunkMask = ~(smallChunkSize - 1ul);
 
     static const size_t mediumMax = 1024;
     static const size_t mediumLineSize = 1024;
     static const size_t mediumLineMask = ~(mediumLineSize - 1ul);
 
-    static const size_t mediumChunkSize = superChunkSize / 4;
-    static const size_t mediumChunkOffset = superChunkSize * 2 / 4;
+    static const size_t mediumChunkSize = superChunkSize / 8;
+    static const size_t mediumChunkOffset = superChunkSize * 6 / 8;
     static const size_t mediumChunkMask = ~(mediumChunkSize - 1ul);
 
+    // Medium-large objects use geometrically spaced size classes, and pages
+    // bigger than a VM page, so a page holds several of the largest objects.
+    static const size_t mediumLargeMax = 32 * kB;
+    static const size_t mediumLargeLineSize = 32 * kB;
+    static const size_t mediumLargeLineMask = ~(mediumLargeLineSize - 1ul);
+    static const size_t mediumLargePageSize = 128 * kB;
+    static const size_t mediumLargeSizeClassesPerDoubling = 4;
+
+    static const size_t mediumLargeChunkSize = superChunkSize / 4;
+    static const size_t mediumLargeChunkOffset = superChunkSize * 2 / 4;
+    static const size_t mediumLargeChunkMask = ~(mediumLargeChunkSize - 1ul);
+
     static const size_t largeChunkSize = superChunkSize / 2;
     static const size_t largeChunkOffset = 0;
     static const size_t largeChunkMask = ~(largeChunkSize - 1ul);
@@ -84,17 +96,36 @@ namespace Sizes {
     static const size_t freeListSearchDepth = 16;
     static const size_t freeListGrowFactor = 2;
 
-    static const uintptr_t typeMask = (superChunkSize - 1) & ~((superChunkSize / 4) - 1); // 4 taggable chunks
+    static const uintptr_t typeMask = (superChunkSize - 1) & ~((superChunkSize / 8) - 1); // 8 taggable chunks
     static const uintptr_t smallType = (superChunkSize + smallChunkOffset) & typeMask;
     static const uintptr_t mediumType = (superChunkSize + mediumChunkOffset) & typeMask;
-    static const uintptr_t largeTypeMask = ~(mediumType & smallType);
-    static const uintptr_t smallOrMediumTypeMask = mediumType & smallType;
-    static const uintptr_t smallOrMediumSmallTypeMask = smallType ^ mediumType; // Only valid if object is known to be small or medium.
+    static const uintptr_t mediumLargeType = (superChunkSize + mediumLargeChunkOffset) & typeMask;
+    static const uintptr_t largeTypeMask = ~(mediumLargeType & mediumType & smallType);
+    static const uintptr_t smallOrMediumTypeMask = mediumLargeType & mediumType & smallType;
+    static const uintptr_t smallOrMediumSmallTypeMask = smallType ^ mediumType; // Only valid if object is known to be small or medium, and not medium-large.
+    static const uintptr_t smallOrMediumMediumLargeTypeMask = mediumType ^ mediumLargeType; // Clear if and only if medium-large, if object is known to be small or medium.
+
+    static const size_t heapShardCount = 8;
+
+    // The transparent huge page size the VMHeap packs pages into, when asked.
+    static const size_t hugePageSize = 2 * MB;
 
     static const size_t deallocatorLogCapacity = 256;
+    // A refill takes between 1 and bumpRangeCacheRefillPageCountMax pages, and
+    // stops early, even partway through a page, once the cache is full. A free
+    // page yields a single range, so slow start needs a range per page. A
+    // fragmented small page yields up to one range per two lines, and the cache
+    // holds one such page.
+    static const size_t bumpRangeCacheRefillPageCountMax = 4;
     static const size_t bumpRangeCacheCapacity = vmPageSize / smallLineSize / 2;
+    static_assert(bumpRangeCacheCapacity >= bumpRangeCacheRefillPageCountMax, "BumpRangeCache must fit a refill of free pages");
+    static const size_t bumpRangeCacheBudget = 512 * kB; // Per thread.
+    static const std::chrono::milliseconds bumpRangeCacheRefillInterval = std::chrono::milliseconds(10);
+    static const size_t transferCacheCapacity = 4;
     
     static const std::chrono::milliseconds scavengeSleepDuration = std::chrono::milliseconds(512);
+    static const std::chrono::milliseconds scavengeDecayTime = std::chrono::milliseconds(10000); // Default; see Environment.
+    static const size_t scavengeBatchSize = 512; // Pages released per lock round trip.
 
     inline size_t sizeClass(size_t size)
     {
@@ -102,9 +133,73 @@ namespace Sizes {
         return mask((size - 1) / alignment, sizeClassMask);
     }
 
+    // Size classes up to mediumMax are spaced by alignment. Medium-large size
+    // classes follow them, mediumLargeSizeClassesPerDoubling per doubling.
+    static const size_t mediumSizeClassCount = mediumMax / alignment;
+    static const size_t mediumLargeSizeClassCount = mediumLargeSizeClassesPerDoubling * log2(mediumLargeMax / mediumMax);
+    static const size_t sizeClassCount = mediumSizeClassCount + mediumLargeSizeClassCount;
+
+    inline size_t mediumLargeSizeClass(size_t size)
+    {
+        BASSERT(size > mediumMax && size <= mediumLargeMax);
+        size_t doubling = log2(size - 1) - log2(mediumMax);
+        size_t base = mediumMax << doubling;
+        size_t step = (size - 1 - base) / (base / mediumLargeSizeClassesPerDoubling);
+        return mediumSizeClassCount + doubling * mediumLargeSizeClassesPerDoubling + step;
+    }
+
     inline size_t objectSize(size_t sizeClass)
     {
-        return (sizeClass + 1) * alignment;
+        if (sizeClass < mediumSizeClassCount)
+            return (sizeClass + 1) * alignment;
+
+        sizeClass -= mediumSizeClassCount;
+        size_t base = mediumMax << (sizeClass / mediumLargeSizeClassesPerDoubling);
+        return base + (sizeClass % mediumLargeSizeClassesPerDoubling + 1) * (base / mediumLargeSizeClassesPerDoubling);
+    }
+
+    // Returns the size that an allocation of the given size rounds up to.
+    inline size_t goodSize(size_t size)
+    {
+        if (size <= mediumMax)
+            return objectSize(sizeClass(size));
+        if (size <= mediumLargeMax)
+            return objectSize(mediumLargeSizeClass(size));
+        if (size <= largeMax)
+            return roundUpToMultipleOf<largeAlignment>(size);
+        return roundUpToMultipleOf<xLargeAlignment>(size);
+    }
+
+    // Objects of a size class are laid out back to back from the start of each
+    // page, so every object is aligned to the largest power of two that divides
+    // both the object size and the page size.
+    inline size_t objectAlignment(size_t sizeClass)
+    {
+        size_t size = objectSize(sizeClass);
+        size_t pageSize = sizeClass < mediumSizeClassCount ? vmPageSize : mediumLargePageSize;
+        return min(size & -size, pageSize);
+    }
+
+    // Returns the smallest object size whose size class guarantees alignment,
+    // or 0 if the request needs a large or XLarge object.
+    inline size_t alignedObjectSize(size_t alignment, size_t size)
+    {
+        BASSERT(isPowerOfTwo(alignment));
+
+        if (alignment <= vmPageSize) {
+            size_t alignedSize = roundUpToMultipleOf(alignment, max(size, alignment));
+            if (alignedSize <= mediumMax)
+                return alignedSize;
+        }
+
+        if (size > mediumLargeMax)
+            return 0;
+
+        for (size_t sizeClass = mediumLargeSizeClass(max(size, mediumMax + 1)); sizeClass < sizeClassCount; ++sizeClass) {
+            if (objectAlignment(sizeClass) >= alignment)
+                return objectSize(sizeClass);
+        }
+        return 0;
     }
 };
 
@@ -40,6 +40,7 @@ struct SmallTraits {
     typedef Page<SmallTraits> PageType;
 
     static const size_t lineSize = smallLineSize;
+    static const size_t pageSize = vmPageSize;
     static const size_t minimumObjectSize = alignment;
     static const size_t chunkSize = smallChunkSize;
     static const size_t chunkOffset = smallChunkOffset;
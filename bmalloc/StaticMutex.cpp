@@ -23,15 +23,76 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
  */
 
+#include "BPlatform.h"
 #include "StaticMutex.h"
 #include <thread>
 
+#if BOS(LINUX)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace bmalloc {
 
+static_assert(sizeof(std::atomic<unsigned>) == sizeof(int), "futex word must be 32 bits");
+
+static inline void spinPause()
+{
+#if BCPU(X86_64)
+    __builtin_ia32_pause();
+#elif BCPU(ARM64)
+    asm volatile("yield" ::: "memory");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// Sleeps until another thread calls unparkOne() on address, unless *address no
+// longer equals expected. May return spuriously.
+static inline void park(std::atomic<unsigned>& address, unsigned expected)
+{
+#if BOS(LINUX)
+    syscall(SYS_futex, reinterpret_cast<int*>(&address), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+    UNUSED(address);
+    UNUSED(expected);
+    std::this_thread::yield();
+#endif
+}
+
+static inline void unparkOne(std::atomic<unsigned>& address)
+{
+#if BOS(LINUX)
+    syscall(SYS_futex, reinterpret_cast<int*>(&address), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+    UNUSED(address);
+#endif
+}
+
 void StaticMutex::lockSlowCase()
 {
-    while (!try_lock())
-        std::this_thread::yield();
+    m_contendedLockCount.fetch_add(1, std::memory_order_relaxed);
+
+    // Critical sections in bmalloc are short, so a brief spin usually
+    // acquires the lock without paying for a system call.
+    for (unsigned i = 0; i < spinLimit; ++i) {
+        if (m_state.load(std::memory_order_relaxed) == Unlocked && try_lock())
+            return;
+        spinPause();
+    }
+
+    // Once we mark the lock as having waiters, we must keep that mark when
+    // we acquire, since we can't tell whether other threads are parked too.
+    while (m_state.exchange(LockedWithWaiters, std::memory_order_acquire) != Unlocked) {
+        m_parkCount.fetch_add(1, std::memory_order_relaxed);
+        park(m_state, LockedWithWaiters);
+    }
+}
+
+void StaticMutex::unlockSlowCase()
+{
+    unparkOne(m_state);
 }
 
 } // namespace bmalloc
@@ -36,6 +36,10 @@
 // Use StaticMutex in static storage, where global constructors and exit-time
 // destructors are prohibited, but all memory is zero-initialized automatically.
 
+// A contended lock spins briefly, then parks on a futex (on Linux) until the
+// owner unlocks. Zero means unlocked, so zero-initialized storage is a valid,
+// unlocked mutex.
+
 namespace bmalloc {
 
 class StaticMutex {
@@ -48,10 +52,22 @@ public:
     bool try_lock();
     void unlock();
 
+    // Contention counters. These are approximate, and only updated on the
+    // slow path, so they cost nothing when the lock is uncontended.
+    size_t contendedLockCount() const { return m_contendedLockCount.load(std::memory_order_relaxed); }
+    size_t parkCount() const { return m_parkCount.load(std::memory_order_relaxed); }
+
 private:
+    enum State : unsigned { Unlocked, Locked, LockedWithWaiters };
+
+    static const unsigned spinLimit = 100;
+
     void lockSlowCase();
+    void unlockSlowCase();
 
-    std::atomic_flag m_flag;
+    std::atomic<unsigned> m_state;
+    std::atomic<size_t> m_contendedLockCount;
+    std::atomic<size_t> m_parkCount;
 };
 
 static inline void sleep(
@@ -77,12 +93,16 @@ static inline void waitUntilFalse(
 
 inline void StaticMutex::init()
 {
-    m_flag.clear();
+    m_state.store(Unlocked, std::memory_order_relaxed);
+    m_contendedLockCount.store(0, std::memory_order_relaxed);
+    m_parkCount.store(0, std::memory_order_relaxed);
 }
 
 inline bool StaticMutex::try_lock()
 {
-    return !m_flag.test_and_set(std::memory_order_acquire);
+    unsigned expected = Unlocked;
+    return m_state.compare_exchange_strong(
+        expected, Locked, std::memory_order_acquire, std::memory_order_relaxed);
 }
 
 inline void StaticMutex::lock()
@@ -93,7 +113,8 @@ inline void StaticMutex::lock()
 
 inline void StaticMutex::unlock()
 {
-    m_flag.clear(std::memory_order_release);
+    if (m_state.exchange(Unlocked, std::memory_order_release) == LockedWithWaiters)
+        unlockSlowCase();
 }
 
 } // namespace bmalloc
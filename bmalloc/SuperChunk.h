@@ -26,35 +26,45 @@
 #ifndef SuperChunk_h
 #define SuperChunk_h
 
+#include "HugeTLBPool.h"
 #include "LargeChunk.h"
 #include "MediumChunk.h"
+#include "MediumLargeChunk.h"
+#include "PerProcess.h"
 #include "SmallChunk.h"
 
 namespace bmalloc {
 
 class SuperChunk {
 public:
-    static SuperChunk* create();
+    static SuperChunk* create(size_t shard);
 
     SmallChunk* smallChunk();
     MediumChunk* mediumChunk();
+    MediumLargeChunk* mediumLargeChunk();
     LargeChunk* largeChunk();
 
 private:
-    SuperChunk();
+    SuperChunk(size_t shard, bool isHugeTLB);
 };
 
-inline SuperChunk* SuperChunk::create()
+inline SuperChunk* SuperChunk::create(size_t shard)
 {
-    void* result = static_cast<char*>(vmAllocate(superChunkSize, superChunkSize));
-    return new (result) SuperChunk;
+    Range hugeTLBRange = PerProcess<HugeTLBPool>::get()->tryAllocate(superChunkSize, superChunkSize);
+    if (!hugeTLBRange) {
+        void* result = static_cast<char*>(vmAllocate(superChunkSize, superChunkSize));
+        return new (result) SuperChunk(shard, false);
+    }
+
+    return new (hugeTLBRange.begin()) SuperChunk(shard, true);
 }
 
-inline SuperChunk::SuperChunk()
+inline SuperChunk::SuperChunk(size_t shard, bool isHugeTLB)
 {
-    new (smallChunk()) SmallChunk;
-    new (mediumChunk()) MediumChunk;
-    new (largeChunk()) LargeChunk;
+    new (smallChunk()) SmallChunk(shard, isHugeTLB);
+    new (mediumChunk()) MediumChunk(shard, isHugeTLB);
+    new (mediumLargeChunk()) MediumLargeChunk(shard, isHugeTLB);
+    new (largeChunk()) LargeChunk(shard, isHugeTLB);
 }
 
 inline SmallChunk* SuperChunk::smallChunk()
@@ -69,6 +79,12 @@ inline MediumChunk* SuperChunk::mediumChunk()
         reinterpret_cast<char*>(this) + mediumChunkOffset);
 }
 
+inline MediumLargeChunk* SuperChunk::mediumLargeChunk()
+{
+    return reinterpret_cast<MediumLargeChunk*>(
+        reinterpret_cast<char*>(this) + mediumLargeChunkOffset);
+}
+
 inline LargeChunk* SuperChunk::largeChunk()
 {
     return reinterpret_cast<LargeChunk*>(
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2015 Apple Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE INC. ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL APPLE INC. OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ */
+
+#ifndef TransferCache_h
+#define TransferCache_h
+
+#include "BumpRange.h"
+#include "StaticMutex.h"
+#include "Sizes.h"
+#include <array>
+#include <atomic>
+#include <mutex>
+
+namespace bmalloc {
+
+// Per-size-class cache of BumpRangeCache batches, shared by the threads bound
+// to one Heap shard. Thread caches give their unused ranges back in O(1), and
+// take a batch in O(1) before falling back to scanning a page. Batches come
+// from surplus refills, from full batches of freed objects, and from threads
+// that scavenge. Ranges in the transfer cache still hold references to their
+// lines.
+//
+// Transfer caches are big, so their locks live apart from them, packed
+// together in the Heap. That way, taking every lock for fork() touches only
+// a few pages.
+
+class TransferCache {
+public:
+    TransferCache();
+
+    void setMutex(StaticMutex& mutex) { m_mutex = &mutex; }
+
+    // Moves a batch into an empty BumpRangeCache.
+    bool tryPop(BumpRangeCache&);
+
+    // Moves a non-empty BumpRangeCache into the transfer cache, leaving it empty.
+    bool tryPush(BumpRangeCache&);
+
+    bool isFull() { return m_size.load(std::memory_order_relaxed) == transferCacheCapacity; }
+
+    // Returns whether anyone pushed or popped since the previous call.
+    bool clearWasUsed() { return m_wasUsed.exchange(false, std::memory_order_relaxed); }
+
+private:
+    StaticMutex* m_mutex;
+    std::atomic<size_t> m_size; // Written under m_mutex, read without it as a hint.
+    std::atomic<bool> m_wasUsed;
+    std::array<BumpRangeCache, transferCacheCapacity> m_batches;
+};
+
+inline TransferCache::TransferCache()
+    : m_mutex(nullptr)
+    , m_size(0)
+    , m_wasUsed(false)
+{
+}
+
+inline bool TransferCache::tryPop(BumpRangeCache& bumpRangeCache)
+{
+    BASSERT(!bumpRangeCache.size());
+    if (!m_size.load(std::memory_order_relaxed))
+        return false;
+
+    std::lock_guard<StaticMutex> lock(*m_mutex);
+    size_t size = m_size.load(std::memory_order_relaxed);
+    if (!size)
+        return false;
+
+    BumpRangeCache& batch = m_batches[size - 1];
+    bumpRangeCache.push(batch.begin(), batch.end());
+    batch.clear();
+    m_size.store(size - 1, std::memory_order_relaxed);
+    m_wasUsed.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+inline bool TransferCache::tryPush(BumpRangeCache& bumpRangeCache)
+{
+    BASSERT(bumpRangeCache.size());
+    if (m_size.load(std::memory_order_relaxed) == transferCacheCapacity)
+        return false;
+
+    std::lock_guard<StaticMutex> lock(*m_mutex);
+    size_t size = m_size.load(std::memory_order_relaxed);
+    if (size == transferCacheCapacity)
+        return false;
+
+    BumpRangeCache& batch = m_batches[size];
+    batch.push(bumpRangeCache.begin(), bumpRangeCache.end());
+    bumpRangeCache.clear();
+    m_size.store(size + 1, std::memory_order_relaxed);
+    m_wasUsed.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+} // namespace bmalloc
+
+#endif // TransferCache_h
@@ -31,6 +31,7 @@
 #include "Sizes.h"
 #include "Syscall.h"
 #include <algorithm>
+#include <atomic>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -128,6 +129,85 @@ inline void* vmAllocate(size_t vmAlignment, size_t vmSize)
     return result;
 }
 
+// Like tryVMAllocate, but maps explicitly reserved huge pages of the given
+// size (MAP_HUGETLB). vmSize and vmAlignment must be multiples of the huge
+// page size. Returns nullptr if the OS has too few reserved huge pages left,
+// or doesn't support them. The OS reserves the pages up front, so we won't
+// fault later for lack of them. We only release them by unmapping the whole
+// mapping.
+inline void* tryVMAllocateHugeTLB(size_t vmAlignment, size_t vmSize, size_t hugeTLBPageSize)
+{
+    BASSERT(isPowerOfTwo(hugeTLBPageSize));
+    BASSERT(!(vmSize % hugeTLBPageSize));
+    BASSERT(!(vmAlignment % hugeTLBPageSize));
+
+#if BOS(LINUX) && defined(MAP_HUGETLB) && defined(MAP_FIXED_NOREPLACE)
+    // Find an aligned hole, then map huge pages into it. If another thread
+    // maps into the hole first, we fail rather than clobber its mapping.
+    void* aligned = tryVMAllocate(vmAlignment, vmSize);
+    if (!aligned)
+        return nullptr;
+    vmDeallocate(aligned, vmSize);
+
+    int flags = MAP_PRIVATE | MAP_ANON | MAP_FIXED_NOREPLACE | MAP_HUGETLB;
+#if defined(MAP_HUGE_SHIFT)
+    flags |= log2(hugeTLBPageSize) << MAP_HUGE_SHIFT;
+#endif
+    void* result = mmap(aligned, vmSize, PROT_READ | PROT_WRITE, flags, BMALLOC_VM_TAG, 0);
+    if (result == MAP_FAILED)
+        return nullptr;
+
+    // Kernels before 4.17 treat MAP_FIXED_NOREPLACE as a hint.
+    if (result != aligned) {
+        vmDeallocate(result, vmSize);
+        return nullptr;
+    }
+    return result;
+#else
+    UNUSED(vmAlignment);
+    UNUSED(vmSize);
+    UNUSED(hugeTLBPageSize);
+    return nullptr;
+#endif
+}
+
+// Grows a mapping to newVMSize bytes without moving it. Fails if the address
+// space after the mapping is in use, or if the OS can't resize mappings.
+inline bool tryVMExtend(void* p, size_t vmSize, size_t newVMSize)
+{
+    vmValidate(p, vmSize);
+    vmValidate(newVMSize);
+    BASSERT(newVMSize > vmSize);
+#if BOS(LINUX)
+    return mremap(p, vmSize, newVMSize, 0) != MAP_FAILED;
+#else
+    return false;
+#endif
+}
+
+// Moves a mapping's pages to newP, replacing the newVMSize bytes mapped there,
+// without copying them. The old range is unmapped. Fails if the OS can't
+// move mappings.
+inline bool tryVMMove(void* p, size_t vmSize, void* newP, size_t newVMSize)
+{
+    vmValidate(p, vmSize);
+    vmValidate(newP, newVMSize);
+    BASSERT(newVMSize >= vmSize);
+#if BOS(LINUX)
+    return mremap(p, vmSize, newVMSize, MREMAP_MAYMOVE | MREMAP_FIXED, newP) != MAP_FAILED;
+#else
+    return false;
+#endif
+}
+
+// Whether pages read as zero after vmDeallocatePhysicalPages. MADV_FREE_REUSABLE
+// may leave their old contents in place.
+#if BOS(DARWIN)
+static const bool vmDeallocatePhysicalPagesZeroes = false;
+#else
+static const bool vmDeallocatePhysicalPagesZeroes = true;
+#endif
+
 inline void vmDeallocatePhysicalPages(void* p, size_t vmSize)
 {
     vmValidate(p, vmSize);
@@ -138,13 +218,51 @@ inline void vmDeallocatePhysicalPages(void* p, size_t vmSize)
 #endif
 }
 
+// Like vmDeallocatePhysicalPages, but the OS may leave pages in place until it
+// needs the memory, so reusing them soon is cheap. Pages may keep their old
+// contents. On Linux, resident size still includes them until the OS reclaims
+// them, so callers should eventually escalate to vmDeallocatePhysicalPages.
+inline void vmDeallocatePhysicalPagesLazily(void* p, size_t vmSize)
+{
+    vmValidate(p, vmSize);
+#if BOS(DARWIN)
+    SYSCALL(madvise(p, vmSize, MADV_FREE_REUSABLE));
+#elif defined(MADV_FREE)
+    // Kernels before 4.5 don't support MADV_FREE.
+    static std::atomic<bool> isMADVFreeSupported(true);
+    if (isMADVFreeSupported.load(std::memory_order_relaxed)) {
+        int result;
+        while ((result = madvise(p, vmSize, MADV_FREE)) == -1 && errno == EAGAIN) { }
+        if (!result || errno != EINVAL)
+            return;
+        isMADVFreeSupported.store(false, std::memory_order_relaxed);
+    }
+    SYSCALL(madvise(p, vmSize, MADV_DONTNEED));
+#else
+    SYSCALL(madvise(p, vmSize, MADV_DONTNEED));
+#endif
+}
+
 inline void vmAllocatePhysicalPages(void* p, size_t vmSize)
 {
     vmValidate(p, vmSize);
 #if BOS(DARWIN)
     SYSCALL(madvise(p, vmSize, MADV_FREE_REUSE));
 #else
-    SYSCALL(madvise(p, vmSize, MADV_NORMAL));
+    // Linux faults pages back in on first touch, so there's nothing to do.
+    UNUSED(p);
+#endif
+}
+
+// Asks the OS to back a range with transparent huge pages. A hint, which
+// does nothing where huge pages aren't supported.
+inline void vmEnableHugePages(void* p, size_t vmSize)
+{
+    vmValidate(p, vmSize);
+#if BOS(LINUX) && defined(MADV_HUGEPAGE)
+    madvise(p, vmSize, MADV_HUGEPAGE);
+#else
+    UNUSED(p);
 #endif
 }
 
@@ -28,22 +28,56 @@
 #include "PerProcess.h"
 #include "SuperChunk.h"
 #include "VMHeap.h"
+#include <algorithm>
 #include <thread>
 
 namespace bmalloc {
 
-VMHeap::VMHeap()
-    : m_largeObjects(Owner::VMHeap)
+VMHeap::VMHeap(size_t shard, bool usesHugePages)
+    : m_shard(shard)
+    , m_usesHugePages(usesHugePages)
+    , m_hugePageStatistics()
+    , m_largeObjects(Owner::VMHeap)
 {
 }
 
-void VMHeap::grow()
+template<typename Chunk>
+void VMHeap::addHugePages(Chunk* chunk, HugePageSet& hugePages)
 {
-    SuperChunk* superChunk = SuperChunk::create();
+    if (!chunk->isHugeTLB())
+        vmEnableHugePages(chunk, Chunk::chunkSize);
+
+    for (auto* it = chunk->begin(); it != chunk->end(); ++it) {
+        HugePage* hugePage = chunk->hugePage(it);
+        hugePage->addPage(it - chunk->firstPage(hugePage));
+    }
+
+    for (size_t i = 0; i < Chunk::hugePageCount; ++i) {
+        HugePage* hugePage = &chunk->hugePages()[i];
+        hugePage->setReleasable(!chunk->isHugeTLB());
+        hugePages.add(hugePage);
+    }
+
+    m_hugePageStatistics.hugePageCount += Chunk::hugePageCount;
+}
+
+void VMHeap::grow(std::lock_guard<StaticMutex>&)
+{
+    SuperChunk* superChunk = SuperChunk::create(m_shard);
 #if BOS(DARWIN)
     m_zone.addSuperChunk(superChunk);
 #endif
 
+    LargeChunk* largeChunk = superChunk->largeChunk();
+    m_largeObjects.insert(LargeObject(LargeObject::init(largeChunk).begin()));
+
+    if (m_usesHugePages) {
+        addHugePages(superChunk->smallChunk(), m_smallHugePages);
+        addHugePages(superChunk->mediumChunk(), m_mediumHugePages);
+        addHugePages(superChunk->mediumLargeChunk(), m_mediumLargeHugePages);
+        return;
+    }
+
     SmallChunk* smallChunk = superChunk->smallChunk();
     for (auto* it = smallChunk->begin(); it != smallChunk->end(); ++it)
         m_smallPages.push(it);
@@ -52,8 +86,186 @@ void VMHeap::grow()
     for (auto* it = mediumChunk->begin(); it != mediumChunk->end(); ++it)
         m_mediumPages.push(it);
 
-    LargeChunk* largeChunk = superChunk->largeChunk();
-    m_largeObjects.insert(LargeObject(LargeObject::init(largeChunk).begin()));
+    MediumLargeChunk* mediumLargeChunk = superChunk->mediumLargeChunk();
+    for (auto* it = mediumLargeChunk->begin(); it != mediumLargeChunk->end(); ++it)
+        m_mediumLargePages.push(it);
+}
+
+// Calls function(begin, size) once for each run of adjacent pages that we can
+// release to the OS. Sorts pages.
+template<typename Page, typename Function>
+static void forEachRun(Page** pages, size_t count, const Function& function)
+{
+    typedef typename Page::Chunk Chunk;
+
+    std::sort(pages, pages + count);
+
+    for (size_t i = 0; i < count; ) {
+        // Adjacent pages share a chunk.
+        bool isHugeTLB = Chunk::get(pages[i])->isHugeTLB();
+        char* begin = pages[i]->begin()->begin();
+        char* end = begin + Page::pageSize;
+        for (++i; i < count && pages[i]->begin()->begin() == end; ++i)
+            end += Page::pageSize;
+        if (!isHugeTLB)
+            function(begin, end - begin);
+    }
+}
+
+template<typename Page>
+void VMHeap::deallocatePages(Vector<Page*>& lazyPages, Page** pages, size_t count)
+{
+    forEachRun(pages, count, [](char* begin, size_t size) {
+        vmDeallocatePhysicalPagesLazily(begin, size);
+    });
+
+    std::lock_guard<StaticMutex> lock(m_mutex);
+    unsigned now = decayClock();
+    for (size_t i = 0; i < count; ++i)
+        pages[i]->setFreeTime(now);
+    lazyPages.push(pages, pages + count);
+}
+
+template<typename Page>
+void VMHeap::deallocatePagesToHugePages(HugePageSet& hugePages, Page** pages, size_t count)
+{
+    typedef typename Page::Chunk Chunk;
+
+    std::lock_guard<StaticMutex> lock(m_mutex);
+    unsigned now = decayClock();
+    for (size_t i = 0; i < count; ++i) {
+        Chunk* chunk = Chunk::get(pages[i]);
+        HugePage* hugePage = chunk->hugePage(pages[i]);
+        hugePages.freePage(hugePage, pages[i] - chunk->firstPage(hugePage), now);
+
+        m_hugePageStatistics.usedBytes -= Page::pageSize;
+        m_hugePageStatistics.freeBytes += Page::pageSize;
+    }
+}
+
+void VMHeap::deallocatePages(SmallPage** pages, size_t count)
+{
+    if (m_usesHugePages)
+        deallocatePagesToHugePages(m_smallHugePages, pages, count);
+    else
+        deallocatePages(m_lazySmallPages, pages, count);
+}
+
+void VMHeap::deallocatePages(MediumPage** pages, size_t count)
+{
+    if (m_usesHugePages)
+        deallocatePagesToHugePages(m_mediumHugePages, pages, count);
+    else
+        deallocatePages(m_lazyMediumPages, pages, count);
+}
+
+void VMHeap::deallocatePages(MediumLargePage** pages, size_t count)
+{
+    if (m_usesHugePages)
+        deallocatePagesToHugePages(m_mediumLargeHugePages, pages, count);
+    else
+        deallocatePages(m_lazyMediumLargePages, pages, count);
+}
+
+template<typename Page>
+bool VMHeap::decommitIdlePages(Vector<Page*>& lazyPages, Vector<Page*>& pages, std::chrono::milliseconds idleTime)
+{
+    // Lazily freed pages are in the order they were freed, so the idle ones
+    // come first. We take them all out at once, since removing them from the
+    // front of the list moves the rest.
+    std::unique_lock<StaticMutex> lock(m_mutex);
+    unsigned now = decayClock();
+    Page** idleEnd = std::partition_point(lazyPages.begin(), lazyPages.end(), [&](Page* page) {
+        return decayAge(now, page->freeTime()) >= idleTime;
+    });
+
+    Vector<Page*> idlePages;
+    idlePages.push(lazyPages.begin(), idleEnd);
+    lazyPages.shift(idlePages.size());
+    bool hasLazyPages = lazyPages.size();
+
+    // We hand pages back in batches, so allocation can reuse them while we
+    // release the rest.
+    for (size_t i = 0; i < idlePages.size(); i += scavengeBatchSize) {
+        size_t count = min(idlePages.size() - i, scavengeBatchSize);
+
+        lock.unlock();
+        forEachRun(idlePages.begin() + i, count, [](char* begin, size_t size) {
+            vmDeallocatePhysicalPages(begin, size);
+        });
+        lock.lock();
+
+        pages.push(idlePages.begin() + i, idlePages.begin() + i + count);
+    }
+
+    return hasLazyPages;
+}
+
+template<typename Page>
+bool VMHeap::decommitFreeHugePages(HugePageSet& hugePages, std::chrono::milliseconds idleTime)
+{
+    typedef typename Page::Chunk Chunk;
+
+    std::unique_lock<StaticMutex> lock(m_mutex);
+    while (true) {
+        // We take the huge pages we release out of the set, so nobody
+        // allocates from them while we're unlocked.
+        FixedVector<HugePage*, 32> idleHugePages;
+        unsigned now = decayClock();
+        while (idleHugePages.size() < idleHugePages.capacity()) {
+            HugePage* hugePage = hugePages.takeIdleHugePage(now, idleTime);
+            if (!hugePage)
+                break;
+            idleHugePages.push(hugePage);
+
+            --m_hugePageStatistics.backedHugePageCount;
+            m_hugePageStatistics.freeBytes -= hugePage->freePageCount() * Page::pageSize;
+        }
+
+        if (idleHugePages.isEmpty())
+            break;
+
+        lock.unlock();
+        for (HugePage* hugePage : idleHugePages) {
+            // The first huge page in a chunk holds the chunk's metadata, which
+            // we have to keep.
+            Chunk* chunk = Chunk::get(hugePage);
+            char* begin = max(chunk->firstPage(hugePage), chunk->begin())->begin()->begin();
+            char* end = chunk->firstPage(hugePage)->begin()->begin() + hugePageSize;
+            vmDeallocatePhysicalPages(begin, end - begin);
+        }
+        lock.lock();
+
+        for (HugePage* hugePage : idleHugePages) {
+            hugePage->setBacked(false);
+            hugePages.add(hugePage);
+        }
+    }
+
+    return hugePages.hasFreeHugePages();
+}
+
+bool VMHeap::decommitIdlePages(std::chrono::milliseconds idleTime)
+{
+    if (m_usesHugePages) {
+        bool hasFreeHugePages = false;
+        hasFreeHugePages |= decommitFreeHugePages<SmallPage>(m_smallHugePages, idleTime);
+        hasFreeHugePages |= decommitFreeHugePages<MediumPage>(m_mediumHugePages, idleTime);
+        hasFreeHugePages |= decommitFreeHugePages<MediumLargePage>(m_mediumLargeHugePages, idleTime);
+        return hasFreeHugePages;
+    }
+
+    bool hasLazyPages = false;
+    hasLazyPages |= decommitIdlePages(m_lazySmallPages, m_smallPages, idleTime);
+    hasLazyPages |= decommitIdlePages(m_lazyMediumPages, m_mediumPages, idleTime);
+    hasLazyPages |= decommitIdlePages(m_lazyMediumLargePages, m_mediumLargePages, idleTime);
+    return hasLazyPages;
+}
+
+HugePageStatistics VMHeap::hugePageStatistics()
+{
+    std::lock_guard<StaticMutex> lock(m_mutex);
+    return m_hugePageStatistics;
 }
 
 } // namespace bmalloc
@@ -27,10 +27,14 @@
 #define VMHeap_h
 
 #include "AsyncTask.h"
+#include "Decay.h"
 #include "FixedVector.h"
+#include "HugePageSet.h"
 #include "LargeChunk.h"
 #include "LargeObject.h"
 #include "MediumChunk.h"
+#include "MediumLargeChunk.h"
+#include "Mutex.h"
 #include "Range.h"
 #include "SegregatedFreeList.h"
 #include "SmallChunk.h"
@@ -46,49 +50,155 @@ class EndTag;
 class Heap;
 class SuperChunk;
 
+// The VMHeap has its own lock, which protects its free lists. It's the last
+// lock in the Heap's lock order. Large objects share boundary tags with the
+// Heap, so large object functions also require the caller to hold the Heap's
+// large object lock.
+//
+// Pages come back to the VMHeap freed lazily, so reusing them soon after is
+// cheap. Once they stay idle long enough, decommitIdlePages releases them for
+// good.
+//
+// In hugepage mode, we ask the OS to back page chunks with transparent huge
+// pages, and track pages per huge page instead. We hand out pages from the
+// fullest huge page, free pages without telling the OS, and only release huge
+// pages whose pages are all free, so we never break one up.
+//
+// Chunks we mapped from the HugeTLBPool stay resident, since the OS can't
+// release part of them, so we never release their pages or large objects.
+
 class VMHeap {
 public:
-    VMHeap();
+    VMHeap(size_t shard, bool usesHugePages = false);
 
     SmallPage* allocateSmallPage();
     MediumPage* allocateMediumPage();
-    LargeObject allocateLargeObject(size_t);
-    LargeObject allocateLargeObject(size_t alignment, size_t, size_t unalignedSize);
+    MediumLargePage* allocateMediumLargePage();
+    LargeObject allocateLargeObject(std::lock_guard<StaticMutex>&, size_t);
+    LargeObject allocateLargeObject(std::lock_guard<StaticMutex>&, size_t alignment, size_t, size_t unalignedSize);
+
+    void deallocateSmallPage(SmallPage*);
+    void deallocateMediumPage(MediumPage*);
+    void deallocateMediumLargePage(MediumLargePage*);
 
-    void deallocateSmallPage(std::unique_lock<StaticMutex>&, SmallPage*);
-    void deallocateMediumPage(std::unique_lock<StaticMutex>&, MediumPage*);
+    // Frees count pages at once, with one system call per run of adjacent
+    // pages and one lock round trip. Reorders pages.
+    void deallocatePages(SmallPage**, size_t count);
+    void deallocatePages(MediumPage**, size_t count);
+    void deallocatePages(MediumLargePage**, size_t count);
     void deallocateLargeObject(std::unique_lock<StaticMutex>&, LargeObject&);
 
+    // Decommits pages that have been lazily freed for at least idleTime.
+    // Returns true if lazily freed pages remain.
+    // In hugepage mode, decommits huge pages that have been free for at least
+    // idleTime, and returns true if free huge pages remain.
+    bool decommitIdlePages(std::chrono::milliseconds idleTime);
+
+    HugePageStatistics hugePageStatistics();
+
+    StaticMutex& mutex() { return m_mutex; }
+
 private:
+    template<typename Page> Page* allocatePage(Vector<Page*>& lazyPages, Vector<Page*>&, HugePageSet&);
+    template<typename Page> void deallocatePages(Vector<Page*>& lazyPages, Page**, size_t count);
+    template<typename Page> bool decommitIdlePages(Vector<Page*>& lazyPages, Vector<Page*>&, std::chrono::milliseconds);
+
+    template<typename Page> Page* allocatePageFromHugePage(std::lock_guard<StaticMutex>&, HugePageSet&);
+    template<typename Page> void deallocatePagesToHugePages(HugePageSet&, Page**, size_t count);
+    template<typename Page> bool decommitFreeHugePages(HugePageSet&, std::chrono::milliseconds);
+    template<typename Chunk> void addHugePages(Chunk*, HugePageSet&);
+
     LargeObject allocateLargeObject(LargeObject&, size_t);
-    void grow();
+    void grow(std::lock_guard<StaticMutex>&);
 
+    Mutex m_mutex;
+    size_t m_shard;
+
+    // Fresh or decommitted pages.
     Vector<SmallPage*> m_smallPages;
     Vector<MediumPage*> m_mediumPages;
+    Vector<MediumLargePage*> m_mediumLargePages;
+
+    // Lazily freed pages, in the order they were freed.
+    Vector<SmallPage*> m_lazySmallPages;
+    Vector<MediumPage*> m_lazyMediumPages;
+    Vector<MediumLargePage*> m_lazyMediumLargePages;
+
+    // In hugepage mode, huge pages that have free pages, instead of the page
+    // lists above.
+    bool m_usesHugePages;
+    HugePageSet m_smallHugePages;
+    HugePageSet m_mediumHugePages;
+    HugePageSet m_mediumLargeHugePages;
+    HugePageStatistics m_hugePageStatistics;
+
     SegregatedFreeList m_largeObjects;
 #if BOS(DARWIN)
     Zone m_zone;
 #endif
 };
 
-inline SmallPage* VMHeap::allocateSmallPage()
+template<typename Page>
+inline Page* VMHeap::allocatePageFromHugePage(std::lock_guard<StaticMutex>& lock, HugePageSet& hugePages)
 {
-    if (!m_smallPages.size())
-        grow();
+    typedef typename Page::Chunk Chunk;
+
+    while (true) {
+        HugePage* hugePage = hugePages.fullest();
+        if (!hugePage) {
+            grow(lock);
+            continue;
+        }
+
+        // Taking a page backs the huge page.
+        if (!hugePage->isBacked()) {
+            ++m_hugePageStatistics.backedHugePageCount;
+            m_hugePageStatistics.freeBytes += hugePage->freePageCount() * Page::pageSize;
+        }
+
+        m_hugePageStatistics.freeBytes -= Page::pageSize;
+        m_hugePageStatistics.usedBytes += Page::pageSize;
+
+        Chunk* chunk = Chunk::get(hugePage);
+        return chunk->firstPage(hugePage) + hugePages.takeFreePage(hugePage);
+    }
+}
 
-    SmallPage* page = m_smallPages.pop();
-    vmAllocatePhysicalPages(page->begin()->begin(), vmPageSize);
+template<typename Page>
+inline Page* VMHeap::allocatePage(Vector<Page*>& lazyPages, Vector<Page*>& pages, HugePageSet& hugePages)
+{
+    Page* page;
+    {
+        // Lazily freed pages may still be resident, so they're cheaper to reuse.
+        std::lock_guard<StaticMutex> lock(m_mutex);
+        if (m_usesHugePages)
+            page = allocatePageFromHugePage<Page>(lock, hugePages);
+        else if (lazyPages.size())
+            page = lazyPages.pop();
+        else {
+            if (!pages.size())
+                grow(lock);
+            page = pages.pop();
+        }
+    }
+
+    vmAllocatePhysicalPages(page->begin()->begin(), Page::pageSize);
     return page;
 }
 
+inline SmallPage* VMHeap::allocateSmallPage()
+{
+    return allocatePage(m_lazySmallPages, m_smallPages, m_smallHugePages);
+}
+
 inline MediumPage* VMHeap::allocateMediumPage()
 {
-    if (!m_mediumPages.size())
-        grow();
+    return allocatePage(m_lazyMediumPages, m_mediumPages, m_mediumHugePages);
+}
 
-    MediumPage* page = m_mediumPages.pop();
-    vmAllocatePhysicalPages(page->begin()->begin(), vmPageSize);
-    return page;
+inline MediumLargePage* VMHeap::allocateMediumLargePage()
+{
+    return allocatePage(m_lazyMediumLargePages, m_mediumLargePages, m_mediumLargeHugePages);
 }
 
 inline LargeObject VMHeap::allocateLargeObject(LargeObject& largeObject, size_t size)
@@ -98,6 +208,8 @@ inline LargeObject VMHeap::allocateLargeObject(LargeObject& largeObject, size_t
     if (largeObject.size() - size > largeMin) {
         std::pair<LargeObject, LargeObject> split = largeObject.split(size);
         largeObject = split.first;
+
+        std::lock_guard<StaticMutex> lock(m_mutex);
         m_largeObjects.insert(split.second);
     }
 
@@ -106,25 +218,33 @@ inline LargeObject VMHeap::allocateLargeObject(LargeObject& largeObject, size_t
     return largeObject.begin();
 }
 
-inline LargeObject VMHeap::allocateLargeObject(size_t size)
+inline LargeObject VMHeap::allocateLargeObject(std::lock_guard<StaticMutex>&, size_t size)
 {
-    LargeObject largeObject = m_largeObjects.take(size);
-    if (!largeObject) {
-        grow();
+    LargeObject largeObject;
+    {
+        std::lock_guard<StaticMutex> lock(m_mutex);
         largeObject = m_largeObjects.take(size);
-        BASSERT(largeObject);
+        if (!largeObject) {
+            grow(lock);
+            largeObject = m_largeObjects.take(size);
+            BASSERT(largeObject);
+        }
     }
 
     return allocateLargeObject(largeObject, size);
 }
 
-inline LargeObject VMHeap::allocateLargeObject(size_t alignment, size_t size, size_t unalignedSize)
+inline LargeObject VMHeap::allocateLargeObject(std::lock_guard<StaticMutex>&, size_t alignment, size_t size, size_t unalignedSize)
 {
-    LargeObject largeObject = m_largeObjects.take(alignment, size, unalignedSize);
-    if (!largeObject) {
-        grow();
+    LargeObject largeObject;
+    {
+        std::lock_guard<StaticMutex> lock(m_mutex);
         largeObject = m_largeObjects.take(alignment, size, unalignedSize);
-        BASSERT(largeObject);
+        if (!largeObject) {
+            grow(lock);
+            largeObject = m_largeObjects.take(alignment, size, unalignedSize);
+            BASSERT(largeObject);
+        }
     }
 
     size_t alignmentMask = alignment - 1;
@@ -133,22 +253,19 @@ inline LargeObject VMHeap::allocateLargeObject(size_t alignment, size_t size, si
     return allocateLargeObject(largeObject, size);
 }
 
-inline void VMHeap::deallocateSmallPage(std::unique_lock<StaticMutex>& lock, SmallPage* page)
+inline void VMHeap::deallocateSmallPage(SmallPage* page)
 {
-    lock.unlock();
-    vmDeallocatePhysicalPages(page->begin()->begin(), vmPageSize);
-    lock.lock();
-    
-    m_smallPages.push(page);
+    deallocatePages(&page, 1);
 }
 
-inline void VMHeap::deallocateMediumPage(std::unique_lock<StaticMutex>& lock, MediumPage* page)
+inline void VMHeap::deallocateMediumPage(MediumPage* page)
 {
-    lock.unlock();
-    vmDeallocatePhysicalPages(page->begin()->begin(), vmPageSize);
-    lock.lock();
-    
-    m_mediumPages.push(page);
+    deallocatePages(&page, 1);
+}
+
+inline void VMHeap::deallocateMediumLargePage(MediumLargePage* page)
+{
+    deallocatePages(&page, 1);
 }
 
 inline void VMHeap::deallocateLargeObject(std::unique_lock<StaticMutex>& lock, LargeObject& largeObject)
@@ -163,12 +280,19 @@ inline void VMHeap::deallocateLargeObject(std::unique_lock<StaticMutex>& lock, L
     // with it or allocating it while we're messing with its physical pages.
     merged.setFree(false);
 
-    lock.unlock();
-    vmDeallocatePhysicalPagesSloppy(merged.begin(), merged.size());
-    lock.lock();
+    // Unlike pages, large objects have already decayed in the Heap, so we
+    // decommit them right away. We can only decommit whole pages, so pages
+    // shared with a neighbor keep their contents, and Heap::allocateLarge
+    // zeroes them itself.
+    if (!LargeChunk::get(merged.begin())->isHugeTLB()) {
+        lock.unlock();
+        vmDeallocatePhysicalPagesSloppy(merged.begin(), merged.size());
+        lock.lock();
+    }
 
     merged.setFree(true);
 
+    std::lock_guard<StaticMutex> vmHeapLock(m_mutex);
     m_largeObjects.insert(merged);
 }
 
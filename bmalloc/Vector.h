@@ -63,6 +63,9 @@ public:
 
     void shrink(size_t);
 
+    // Removes the first count items, preserving the order of the rest.
+    void shift(size_t count);
+
 private:
     static const size_t growFactor = 2;
     static const size_t shrinkFactor = 4;
@@ -143,6 +146,14 @@ inline void Vector<T>::shrink(size_t size)
         shrinkCapacity();
 }
 
+template<typename T>
+inline void Vector<T>::shift(size_t count)
+{
+    BASSERT(count <= m_size);
+    std::memmove(m_buffer, m_buffer + count, (m_size - count) * sizeof(T));
+    shrink(m_size - count);
+}
+
 template<typename T>
 void Vector<T>::reallocateBuffer(size_t newCapacity)
 {
@@ -25,8 +25,9 @@
 
 #include "Cache.h"
 #include "Heap.h"
-#include "PerProcess.h"
+#include "PerShard.h"
 #include "StaticMutex.h"
+#include <limits>
 
 namespace bmalloc {
 namespace api {
@@ -43,12 +44,40 @@ inline void* malloc(size_t size)
     return Cache::allocate(size);
 }
 
+// Returns null on failure.
+inline void* tryMemalign(size_t alignment, size_t size)
+{
+    return Cache::tryAllocate(alignment, size);
+}
+
 // Crashes on failure.
 inline void* memalign(size_t alignment, size_t size)
 {
     return Cache::allocate(alignment, size);
 }
 
+// Returns how many bytes the object can hold, which is at least the size it
+// was allocated with. Lock-free for objects up to mediumLargeMax.
+inline size_t usableSize(void* object)
+{
+    return Cache::usableSize(object);
+}
+
+// Returns the size that a malloc of the given size rounds up to, so callers
+// can request exactly that and use all of it.
+inline size_t goodSize(size_t size)
+{
+    return bmalloc::goodSize(size);
+}
+
+// Returns count * size zero-filled bytes. Crashes on failure, including when
+// count * size overflows.
+inline void* calloc(size_t count, size_t size)
+{
+    RELEASE_BASSERT(!size || count <= std::numeric_limits<size_t>::max() / size);
+    return Cache::allocateZeroed(count * size);
+}
+
 // Crashes on failure.
 inline void* realloc(void* object, size_t newSize)
 {
@@ -60,6 +89,67 @@ inline void free(void* object)
     Cache::deallocate(object);
 }
 
+// Like free, but takes the object's type from size, which must be the size
+// passed to the malloc, tryMalloc or realloc call that returned the object.
+// Debug builds check it.
+inline void freeSized(void* object, size_t size)
+{
+    Cache::deallocate(object, size);
+}
+
+// Stores count objects of the given size in objects. Crashes on failure.
+inline void batchMalloc(size_t size, size_t count, void** objects)
+{
+    Cache::batchAllocate(size, count, objects);
+}
+
+// Frees count objects. Reorders the objects array.
+inline void batchFree(void** objects, size_t count)
+{
+    Cache::batchDeallocate(objects, count);
+}
+
+// Returns how many times per second, across all shards, caches refilled
+// objects of the given size from the heap, since the previous call for
+// that size.
+inline double refillsPerSecond(size_t size)
+{
+    RELEASE_BASSERT(size && size <= mediumLargeMax);
+    size_t sizeClass = size <= mediumMax ? bmalloc::sizeClass(size) : mediumLargeSizeClass(size);
+
+    double result = 0;
+    for (size_t shard = 0; shard < heapShardCount; ++shard) {
+        Heap* heap = PerShard<Heap>::getFastCase(shard);
+        if (!heap)
+            continue;
+
+        StaticMutex& mutex = size <= smallMax ? heap->smallMutex(sizeClass)
+            : size <= mediumMax ? heap->mediumMutex(sizeClass) : heap->mediumLargeMutex(sizeClass);
+        std::lock_guard<StaticMutex> lock(mutex);
+        result += heap->refillsPerSecond(lock, sizeClass);
+    }
+    return result;
+}
+
+// Reports how densely the heap packs small, medium and medium-large pages into
+// huge pages. Only hugepage mode (BMALLOC_HUGE_PAGES=1) tracks huge pages.
+inline HugePageStatistics hugePageStatistics()
+{
+    HugePageStatistics result = { };
+    for (size_t shard = 0; shard < heapShardCount; ++shard) {
+        Heap* heap = PerShard<Heap>::getFastCase(shard);
+        if (!heap)
+            continue;
+
+        HugePageStatistics statistics = heap->hugePageStatistics();
+        result.hugePageCount += statistics.hugePageCount;
+        result.backedHugePageCount += statistics.backedHugePageCount;
+        result.usedBytes += statistics.usedBytes;
+        result.freeBytes += statistics.freeBytes;
+    }
+    return result;
+}
+
 inline void scavengeThisThread()
 {
     Cache::scavenge();
@@ -68,9 +158,17 @@ inline void scavengeThisThread()
 inline void scavenge()
 {
     scavengeThisThread();
+#if HAVE_RSEQ
+    CPUCache::scavenge();
+#endif
+
+    for (size_t shard = 0; shard < heapShardCount; ++shard) {
+        Heap* heap = PerShard<Heap>::getFastCase(shard);
+        if (!heap)
+            continue;
 
-    std::unique_lock<StaticMutex> lock(PerProcess<Heap>::mutex());
-    PerProcess<Heap>::get()->scavenge(lock, std::chrono::milliseconds(0));
+        heap->scavenge(std::chrono::milliseconds(0));
+    }
 }
 
 } // namespace api
@@ -31,9 +31,12 @@ extern "C" {
 
 EXPORT void* mbmalloc(size_t);
 EXPORT void* mbmemalign(size_t, size_t);
+EXPORT void* mbcalloc(size_t, size_t);
 EXPORT void mbfree(void*, size_t);
 EXPORT void* mbrealloc(void*, size_t, size_t);
 EXPORT void mbscavenge();
+EXPORT void mbbatchmalloc(size_t, size_t, void**);
+EXPORT void mbbatchfree(void**, size_t);
     
 void* mbmalloc(size_t size)
 {
@@ -45,8 +48,15 @@ void* mbmemalign(size_t alignment, size_t size)
     return bmalloc::api::memalign(alignment, size);
 }
 
+void* mbcalloc(size_t count, size_t size)
+{
+    return bmalloc::api::calloc(count, size);
+}
+
 void mbfree(void* p, size_t)
 {
+    // Our size hint isn't valid for objects from mbmemalign, which can be
+    // large at any size, so we can't use freeSized.
     bmalloc::api::free(p);
 }
 
@@ -60,4 +70,14 @@ void mbscavenge()
     bmalloc::api::scavenge();
 }
 
+void mbbatchmalloc(size_t size, size_t count, void** objects)
+{
+    bmalloc::api::batchMalloc(size, count, objects);
+}
+
+void mbbatchfree(void** objects, size_t count)
+{
+    bmalloc::api::batchFree(objects, count);
+}
+
 } // extern "C"
@@ -48,9 +48,9 @@ public:
         return static_cast<value_type*>(AllocatorTraits::malloc(sizeof(T) * n));
     }
 
-    void deallocate(value_type* ptr, std::size_t)
+    void deallocate(value_type* ptr, std::size_t n)
     {
-        AllocatorTraits::free(static_cast<void*>(ptr));
+        AllocatorTraits::free(static_cast<void*>(ptr), sizeof(T) * n);
     }
 
     Allocator() noexcept { }
@@ -32,9 +32,9 @@ struct BMallocTraits {
         return bmalloc::api::malloc(size);
     }
 
-    static void free(void* ptr)
+    static void free(void* ptr, size_t size)
     {
-        bmalloc::api::free(ptr);
+        bmalloc::api::freeSized(ptr, size);
     }
 };
 
@@ -32,7 +32,7 @@ struct JEMallocTraits {
         return je_malloc(size);
     }
 
-    static void free(void* ptr)
+    static void free(void* ptr, size_t)
     {
         je_free(ptr);
     }
@@ -0,0 +1,125 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+#include <helper/API.h>
+
+static const size_t batchSizes[] = { 16, 200, 800, 4096, 20000, 64 * 1024 };
+
+TEST(TestBatch, BatchMalloc) {
+    for (size_t size : batchSizes) {
+        std::vector<void*> objects(1000);
+        bmalloc::api::batchMalloc(size, objects.size(), objects.data());
+        for (size_t i = 0; i < objects.size(); ++i)
+            memset(objects[i], static_cast<int>(i), size);
+
+        std::vector<void*> sorted(objects);
+        std::sort(sorted.begin(), sorted.end());
+        EXPECT_EQ(sorted.end(), std::adjacent_find(sorted.begin(), sorted.end()));
+
+        for (size_t i = 0; i < objects.size(); ++i) {
+            EXPECT_EQ(static_cast<unsigned char>(i), static_cast<unsigned char*>(objects[i])[size - 1]);
+            bmalloc::api::free(objects[i]);
+        }
+    }
+}
+
+TEST(TestBatch, BatchMallocOnNewThread) {
+    // A fresh thread has no cache yet, so the batch starts on the slow path.
+    std::thread thread([]() {
+        void* objects[64];
+        bmalloc::api::batchMalloc(32, 64, objects);
+        for (void* object : objects)
+            bmalloc::api::free(object);
+    });
+    thread.join();
+}
+
+TEST(TestBatch, BatchFree) {
+    // Mix every object type, with several objects per line, and some objects
+    // from another thread's shard. No other test uses these small, medium and
+    // medium-large size classes, so their lines hold only our objects.
+    static const size_t sizes[] = { 120, 968, 5000, 64 * 1024 };
+    std::vector<void*> objects;
+    std::thread producer([&objects]() {
+        for (size_t size : sizes)
+            objects.push_back(bmalloc::api::malloc(size));
+    });
+    producer.join();
+
+    for (size_t size : sizes) {
+        for (int i = 0; i < 100; ++i)
+            objects.push_back(bmalloc::api::malloc(size));
+    }
+    objects.push_back(bmalloc::api::malloc(20 * 1024 * 1024));
+    objects.push_back(nullptr);
+    std::reverse(objects.begin(), objects.end());
+
+    std::set<bmalloc::SmallLine*> smallLines;
+    std::set<bmalloc::MediumLine*> mediumLines;
+    std::set<bmalloc::MediumLargeLine*> mediumLargeLines;
+    for (void* object : objects) {
+        if (!object)
+            continue;
+        switch (bmalloc::objectType(object)) {
+        case bmalloc::Small:
+            smallLines.insert(bmalloc::SmallLine::get(object));
+            break;
+        case bmalloc::Medium:
+            mediumLines.insert(bmalloc::MediumLine::get(object));
+            break;
+        case bmalloc::MediumLarge:
+            mediumLargeLines.insert(bmalloc::MediumLargeLine::get(object));
+            break;
+        default:
+            break;
+        }
+    }
+    EXPECT_FALSE(smallLines.empty());
+    EXPECT_FALSE(mediumLines.empty());
+    EXPECT_FALSE(mediumLargeLines.empty());
+
+    bmalloc::api::batchFree(objects.data(), objects.size());
+    bmalloc::api::scavenge();
+
+    // Every line gave up all its references, and took its page along.
+    for (bmalloc::SmallLine* line : smallLines) {
+        EXPECT_EQ(0u, line->refCount());
+        EXPECT_EQ(0u, bmalloc::SmallPage::get(line)->refCount());
+    }
+    for (bmalloc::MediumLine* line : mediumLines) {
+        EXPECT_EQ(0u, line->refCount());
+        EXPECT_EQ(0u, bmalloc::MediumPage::get(line)->refCount());
+    }
+    for (bmalloc::MediumLargeLine* line : mediumLargeLines) {
+        EXPECT_EQ(0u, line->refCount());
+        EXPECT_EQ(0u, bmalloc::MediumLargePage::get(line)->refCount());
+    }
+}
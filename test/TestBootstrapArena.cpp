@@ -0,0 +1,64 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/BootstrapArena.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace bmalloc;
+
+TEST(TestBootstrapArena, AllocatesAlignedObjects) {
+    std::vector<void*> objects;
+    for (size_t alignment = 1; alignment <= 4096; alignment *= 2) {
+        for (size_t size = 0; size <= 10000; size = size * 2 + 1) {
+            void* object = BootstrapArena::allocate(alignment, size);
+            ASSERT_TRUE(object);
+            EXPECT_TRUE(BootstrapArena::contains(object));
+            EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(object) % alignment);
+            EXPECT_GE(BootstrapArena::usableSize(object), size);
+            memset(object, 'a', BootstrapArena::usableSize(object));
+            objects.push_back(object);
+        }
+    }
+
+    for (void* object : objects)
+        BootstrapArena::deallocate(object);
+}
+
+TEST(TestBootstrapArena, ReusesFreedObjects) {
+    void* object = BootstrapArena::allocate(16, 100);
+    BootstrapArena::deallocate(object);
+    EXPECT_EQ(object, BootstrapArena::allocate(16, 100));
+    BootstrapArena::deallocate(object);
+}
+
+TEST(TestBootstrapArena, FailsWhenFull) {
+    EXPECT_FALSE(BootstrapArena::allocate(16, 64 * 1024 * 1024));
+
+    int local;
+    EXPECT_FALSE(BootstrapArena::contains(&local));
+}
@@ -0,0 +1,106 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <helper/API.h>
+#include <bmalloc/Rseq.h>
+
+#if HAVE_RSEQ
+
+TEST(TestCPUCache, RseqBump) {
+    int cpu = bmalloc::rseqCurrentCPU();
+    if (cpu < 0)
+        return;
+
+    char buffer[16 * 4];
+    uint64_t word = bmalloc::makeBumpWord(buffer, 4);
+    void* object = nullptr;
+    for (int i = 0; i < 4; ++i) {
+        bmalloc::RseqResult result;
+        do {
+            cpu = bmalloc::rseqCurrentCPU();
+            result = bmalloc::rseqBumpAllocate(cpu, &word, 16, object);
+        } while (result == bmalloc::RseqResult::Aborted);
+        EXPECT_EQ(bmalloc::RseqResult::Committed, result);
+        EXPECT_EQ(buffer + 16 * i, object);
+    }
+
+    cpu = bmalloc::rseqCurrentCPU();
+    EXPECT_NE(bmalloc::RseqResult::Committed, bmalloc::rseqBumpAllocate(cpu, &word, 16, object));
+}
+
+TEST(TestCPUCache, RseqPushPop) {
+    if (bmalloc::rseqCurrentCPU() < 0)
+        return;
+
+    void* buffer[8];
+    uint64_t size = 0;
+    for (uintptr_t i = 1; i <= 8; ++i) {
+        while (bmalloc::rseqPush(bmalloc::rseqCurrentCPU(), &size, buffer, 8, reinterpret_cast<void*>(i)) == bmalloc::RseqResult::Aborted) { }
+    }
+    EXPECT_EQ(8u, size);
+    EXPECT_NE(bmalloc::RseqResult::Committed, bmalloc::rseqPush(bmalloc::rseqCurrentCPU(), &size, buffer, 8, nullptr));
+
+    for (uintptr_t i = 8; i >= 1; --i) {
+        void* object = nullptr;
+        while (bmalloc::rseqPop(bmalloc::rseqCurrentCPU(), &size, buffer, object) == bmalloc::RseqResult::Aborted) { }
+        EXPECT_EQ(reinterpret_cast<void*>(i), object);
+    }
+    EXPECT_EQ(0u, size);
+}
+
+#endif // HAVE_RSEQ
+
+TEST(TestCPUCache, ConcurrentAllocation) {
+    // Exercises per-CPU caches when BMALLOC_PER_CPU_CACHE is set, and the
+    // per-thread caches otherwise.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([t]() {
+            std::vector<unsigned char*> objects;
+            for (int i = 0; i < 20000; ++i) {
+                size_t size = 16 + (i * 40) % 1024;
+                unsigned char* object = static_cast<unsigned char*>(bmalloc::api::malloc(size));
+                memset(object, t, size);
+                objects.push_back(object);
+                if (objects.size() > 100) {
+                    size_t index = i % objects.size();
+                    EXPECT_EQ(t, objects[index][0]);
+                    bmalloc::api::free(objects[index]);
+                    objects[index] = objects.back();
+                    objects.pop_back();
+                }
+            }
+            for (unsigned char* object : objects)
+                bmalloc::api::free(object);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    bmalloc::api::scavenge();
+}
@@ -0,0 +1,127 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/bmalloc.h>
+#include <cstring>
+#include <vector>
+
+using namespace bmalloc;
+
+static bool isZero(void* object, size_t size)
+{
+    char* begin = static_cast<char*>(object);
+    for (char* it = begin; it != begin + size; ++it) {
+        if (*it)
+            return false;
+    }
+    return true;
+}
+
+TEST(TestCalloc, ReusedMemoryIsZeroed) {
+    const size_t sizes[] = { 1, 16, 256, 1000, 4096, 20000, 64 * 1024, 1024 * 1024, 20 * 1024 * 1024 };
+    for (size_t size : sizes) {
+        std::vector<void*> objects;
+        for (size_t i = 0; i < 4; ++i) {
+            void* object = api::malloc(size);
+            memset(object, 'a', size);
+            objects.push_back(object);
+        }
+        for (void* object : objects)
+            api::free(object);
+
+        for (void*& object : objects) {
+            object = api::calloc(1, size);
+            EXPECT_TRUE(isZero(object, size)) << size;
+        }
+        for (void* object : objects)
+            api::free(object);
+    }
+}
+
+TEST(TestCalloc, CountTimesSize) {
+    char* object = static_cast<char*>(api::calloc(100, 300));
+    EXPECT_TRUE(isZero(object, 100 * 300));
+    memset(object, 'a', 100 * 300);
+    api::free(object);
+
+    object = static_cast<char*>(api::calloc(0, 300));
+    EXPECT_TRUE(object);
+    api::free(object);
+}
+
+TEST(TestCalloc, ScavengedLargeObjectsAreZeroed) {
+    // Scavenged large objects don't start or end on page boundaries, so the
+    // OS only zeroes the pages in their middle.
+    const size_t size = 40000;
+    std::vector<void*> objects;
+    for (size_t i = 0; i < 800; ++i) {
+        void* object = api::malloc(size);
+        memset(object, 0xAA, size);
+        objects.push_back(object);
+    }
+    for (size_t i = 0; i < objects.size(); i += 2)
+        api::free(objects[i]);
+    api::scavenge();
+
+    std::vector<void*> reused;
+    for (size_t i = 0; i < objects.size() / 2; ++i) {
+        void* object = api::calloc(1, size);
+        EXPECT_TRUE(isZero(object, size)) << i;
+        reused.push_back(object);
+    }
+
+    for (void* object : reused)
+        api::free(object);
+    for (size_t i = 1; i < objects.size(); i += 2)
+        api::free(objects[i]);
+}
+
+TEST(TestCalloc, FreshLargeObjectsAreKnownZero) {
+    // Return the heap's free large objects to the VM heap, so the next large
+    // allocation has to come from there.
+    api::scavenge();
+
+    Heap* heap = PerShard<Heap>::get(0);
+    const size_t size = 4 * 1024 * 1024;
+    bool isZeroed;
+    void* object;
+    {
+        std::lock_guard<StaticMutex> lock(heap->largeMutex());
+        object = heap->allocateLarge(lock, size, isZeroed);
+    }
+    // We never decommit huge TLB pages, so we can't know they're zero.
+    EXPECT_EQ(vmDeallocatePhysicalPagesZeroes && !LargeChunk::get(object)->isHugeTLB(), isZeroed);
+    EXPECT_TRUE(isZero(object, size));
+    memset(object, 'a', size);
+
+    {
+        std::lock_guard<StaticMutex> lock(heap->largeMutex());
+        heap->deallocateLarge(lock, object);
+        object = heap->allocateLarge(lock, size, isZeroed);
+        EXPECT_FALSE(isZeroed);
+        heap->deallocateLarge(lock, object);
+    }
+}
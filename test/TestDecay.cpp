@@ -0,0 +1,108 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/Decay.h>
+#include <bmalloc/Vector.h>
+#include <limits>
+#include <vector>
+
+using namespace bmalloc;
+
+TEST(Decay, WeightFallsFromOneToZero)
+{
+    std::chrono::milliseconds decayTime(10000);
+
+    EXPECT_EQ(1, decayWeight(std::chrono::milliseconds(0), decayTime));
+    EXPECT_DOUBLE_EQ(0.5, decayWeight(decayTime / 2, decayTime));
+    EXPECT_EQ(0, decayWeight(decayTime, decayTime));
+    EXPECT_EQ(0, decayWeight(decayTime * 2, decayTime));
+
+    double previous = 1;
+    for (std::chrono::milliseconds age(0); age <= decayTime; age += std::chrono::milliseconds(100)) {
+        double weight = decayWeight(age, decayTime);
+        EXPECT_LE(weight, previous);
+        previous = weight;
+    }
+}
+
+TEST(Decay, ZeroDecayTimeReleasesImmediately)
+{
+    EXPECT_EQ(0, decayWeight(std::chrono::milliseconds(0), std::chrono::milliseconds(0)));
+}
+
+TEST(Decay, AgeSurvivesClockWrap)
+{
+    unsigned then = std::numeric_limits<unsigned>::max() - 10;
+    EXPECT_EQ(std::chrono::milliseconds(21), decayAge(10, then));
+}
+
+namespace {
+
+struct FreePage {
+    unsigned freeTime() { return m_freeTime; }
+    unsigned m_freeTime;
+};
+
+} // namespace
+
+TEST(Decay, BucketedWeightIsCloseToExactWeight)
+{
+    std::chrono::milliseconds decayTime(10000);
+    unsigned now = 100;
+
+    // Oldest first, including pages past decayTime and a clock wrap.
+    std::vector<FreePage> freePages;
+    for (int age = 12000; age > 0; age -= 7)
+        freePages.push_back(FreePage { now - age });
+
+    std::vector<FreePage*> pages;
+    double exactWeight = 0;
+    for (FreePage& page : freePages) {
+        pages.push_back(&page);
+        exactWeight += decayWeight(decayAge(now, page.freeTime()), decayTime);
+    }
+
+    double weight = decayWeight(pages.data(), pages.data() + pages.size(), now, decayTime);
+    EXPECT_GT(exactWeight, 0);
+    EXPECT_NEAR(exactWeight, weight, pages.size() * 0.75 / decayBucketCount);
+
+    EXPECT_EQ(0, decayWeight(pages.data(), pages.data() + pages.size(), now, std::chrono::milliseconds(0)));
+}
+
+TEST(Decay, VectorShiftKeepsOrder)
+{
+    Vector<size_t> vector;
+    for (size_t i = 0; i < 10; ++i)
+        vector.push(i);
+
+    vector.shift(3);
+    EXPECT_EQ(7u, vector.size());
+    for (size_t i = 0; i < vector.size(); ++i)
+        EXPECT_EQ(i + 3, vector[i]);
+
+    vector.shift(vector.size());
+    EXPECT_EQ(0u, vector.size());
+}
@@ -0,0 +1,115 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <bmalloc/bmalloc.h>
+#include <cstring>
+#include <set>
+#include <sys/mman.h>
+#include <vector>
+
+using namespace bmalloc;
+
+static bool isResident(void* page)
+{
+    unsigned char vector;
+    EXPECT_EQ(0, mincore(page, vmPageSize, &vector));
+    return vector & 1;
+}
+
+// VMHeaps never give their chunks back, so these tests share one, and each
+// returns the pages it takes.
+static VMHeap& sharedVMHeap()
+{
+    static VMHeap vmHeap(0);
+    return vmHeap;
+}
+
+TEST(Decommit, ScavengeDecommitsFreePages)
+{
+    std::vector<void*> objects(16384);
+    for (void*& object : objects) {
+        object = api::malloc(256);
+        memset(object, 'a', 256);
+    }
+
+    // We never decommit huge TLB pages.
+    std::set<void*> pages;
+    for (void* object : objects) {
+        if (!SmallChunk::get(object)->isHugeTLB())
+            pages.insert(mask(object, ~(vmPageSize - 1)));
+    }
+    if (pages.empty())
+        return;
+
+    for (void* object : objects)
+        api::free(object);
+    api::scavenge();
+
+    // Pages shared with objects allocated outside this test stay resident.
+    size_t residentCount = 0;
+    for (void* page : pages)
+        residentCount += isResident(page);
+    EXPECT_LT(residentCount, pages.size() / 10);
+}
+
+TEST(Decommit, LazilyFreedPagesAreReusable)
+{
+    VMHeap& vmHeap = sharedVMHeap();
+    SmallPage* page = vmHeap.allocateSmallPage();
+    char* begin = page->begin()->begin();
+    memset(begin, 'a', vmPageSize);
+
+    vmHeap.deallocateSmallPage(page);
+    EXPECT_TRUE(vmHeap.decommitIdlePages(std::chrono::hours(1)));
+
+    // We reuse lazily freed pages first, and they need no syscall to use.
+    EXPECT_EQ(page, vmHeap.allocateSmallPage());
+    memset(begin, 'b', vmPageSize);
+    vmHeap.deallocateSmallPage(page);
+
+    EXPECT_FALSE(vmHeap.decommitIdlePages(std::chrono::milliseconds(0)));
+    EXPECT_FALSE(isResident(begin));
+}
+
+TEST(Decommit, DeallocatePagesCoalescesRuns)
+{
+    VMHeap& vmHeap = sharedVMHeap();
+    std::vector<SmallPage*> pages;
+    for (size_t i = 0; i < 64; ++i) {
+        SmallPage* page = vmHeap.allocateSmallPage();
+        memset(page->begin()->begin(), 'a', vmPageSize);
+        pages.push_back(page);
+    }
+
+    std::reverse(pages.begin(), pages.end());
+    vmHeap.deallocatePages(pages.data(), pages.size());
+    EXPECT_TRUE(std::is_sorted(pages.begin(), pages.end()));
+
+    EXPECT_FALSE(vmHeap.decommitIdlePages(std::chrono::milliseconds(0)));
+    for (SmallPage* page : pages)
+        EXPECT_FALSE(isResident(page->begin()->begin()));
+}
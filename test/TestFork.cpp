@@ -0,0 +1,80 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <bmalloc/bmalloc.h>
+#include <cstring>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace bmalloc;
+
+static const size_t sizes[] = { 16, 200, 1000, 20000, 100 * 1024, 20 * 1024 * 1024 };
+
+static void churn(size_t iterations)
+{
+    for (size_t i = 0; i < iterations; ++i) {
+        size_t size = sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+        void* object = api::malloc(size);
+        memset(object, 'a', std::min<size_t>(size, 4096));
+        api::free(object);
+    }
+}
+
+TEST(TestFork, ChildCanAllocateWhileParentThreadsAllocate) {
+    std::atomic<bool> isDone(false);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 4; ++i) {
+        threads.emplace_back([&isDone] {
+            while (!isDone)
+                churn(100);
+        });
+    }
+
+    for (size_t i = 0; i < 100; ++i) {
+        pid_t pid = fork();
+        ASSERT_NE(-1, pid);
+        if (!pid) {
+            // A deadlock kills the child.
+            alarm(5);
+            churn(1000);
+            api::scavenge();
+            churn(1000);
+            _exit(0);
+        }
+
+        int status;
+        ASSERT_EQ(pid, waitpid(pid, &status, 0));
+        EXPECT_TRUE(WIFEXITED(status));
+        EXPECT_EQ(0, WEXITSTATUS(status));
+    }
+
+    isDone = true;
+    for (auto& thread : threads)
+        thread.join();
+}
@@ -0,0 +1,109 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/bmalloc.h>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace bmalloc;
+
+// Twice as many threads as shards, so threads share each shard's locks.
+static const size_t threadCount = 2 * heapShardCount;
+
+// Each size takes a different one of the shard's locks, and every thread uses
+// the same size class for each. No other test uses these small and medium
+// size classes, so their pages hold only our objects.
+static const size_t sizes[] = { 72, 904, 64 * 1024, 20 * 1024 * 1024 };
+
+// One XLarge object per round, so we don't map gigabytes.
+static size_t testObjectSize(size_t i)
+{
+    return i ? sizes[i % 3] : sizes[3];
+}
+
+TEST(TestHeapLocks, ConcurrentAllocationAcrossObjectTypes) {
+    std::mutex linesMutex;
+    std::set<SmallLine*> smallLines;
+    std::set<MediumLine*> mediumLines;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t]() {
+            std::set<SmallLine*> threadSmallLines;
+            std::set<MediumLine*> threadMediumLines;
+            unsigned char tag = static_cast<unsigned char>(t + 1);
+
+            for (size_t round = 0; round < 20; ++round) {
+                std::vector<unsigned char*> objects;
+                for (size_t i = 0; i < 200; ++i) {
+                    size_t size = testObjectSize(i);
+                    unsigned char* object = static_cast<unsigned char*>(api::malloc(size));
+                    object[0] = object[size - 1] = tag;
+                    objects.push_back(object);
+
+                    if (size == sizes[0])
+                        threadSmallLines.insert(SmallLine::get(object));
+                    else if (size == sizes[1])
+                        threadMediumLines.insert(MediumLine::get(object));
+                }
+
+                // Another thread handing out the same memory would overwrite
+                // our tags.
+                for (size_t i = 0; i < objects.size(); ++i) {
+                    size_t size = testObjectSize(i);
+                    EXPECT_EQ(tag, objects[i][0]);
+                    EXPECT_EQ(tag, objects[i][size - 1]);
+                    api::free(objects[i]);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(linesMutex);
+            smallLines.insert(threadSmallLines.begin(), threadSmallLines.end());
+            mediumLines.insert(threadMediumLines.begin(), threadMediumLines.end());
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    // Drop the references caches still hold to objects nobody allocated.
+    api::scavenge();
+
+    // Every reference we took was dropped exactly once, under whichever lock
+    // its shard uses for it, so nothing is left referenced.
+    EXPECT_FALSE(smallLines.empty());
+    for (SmallLine* line : smallLines) {
+        EXPECT_EQ(0u, line->refCount());
+        EXPECT_EQ(0u, SmallPage::get(line)->refCount());
+    }
+
+    EXPECT_FALSE(mediumLines.empty());
+    for (MediumLine* line : mediumLines) {
+        EXPECT_EQ(0u, line->refCount());
+        EXPECT_EQ(0u, MediumPage::get(line)->refCount());
+    }
+}
@@ -0,0 +1,148 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/bmalloc.h>
+#include <cstring>
+#include <sys/mman.h>
+#include <vector>
+
+using namespace bmalloc;
+
+static bool isResident(void* page)
+{
+    unsigned char vector;
+    EXPECT_EQ(0, mincore(page, vmPageSize, &vector));
+    return vector & 1;
+}
+
+static HugePage* hugePage(SmallPage* page)
+{
+    return SmallChunk::get(page)->hugePage(page);
+}
+
+TEST(HugePage, TakesLowestFreePage)
+{
+    HugePage hugePage = { };
+    for (size_t i = 0; i < HugePage::maxPageCount; ++i)
+        hugePage.addPage(i);
+    EXPECT_TRUE(hugePage.isFree());
+
+    EXPECT_EQ(0u, hugePage.takeFreePage());
+    EXPECT_EQ(1u, hugePage.takeFreePage());
+    EXPECT_EQ(2u, hugePage.takeFreePage());
+    hugePage.freePage(1);
+    EXPECT_EQ(1u, hugePage.takeFreePage());
+    EXPECT_EQ(HugePage::maxPageCount - 3, hugePage.freePageCount());
+}
+
+TEST(HugePage, SetPicksFullestBackedHugePage)
+{
+    HugePage hugePages[3] = { };
+    HugePageSet set;
+    for (HugePage& hugePage : hugePages) {
+        for (size_t i = 0; i < HugePage::maxPageCount; ++i)
+            hugePage.addPage(i);
+        hugePage.setReleasable(true);
+        set.add(&hugePage);
+    }
+
+    // Nothing is backed yet, so we start on the first huge page we added,
+    // and keep filling it.
+    EXPECT_EQ(&hugePages[0], set.fullest());
+    set.takeFreePage(&hugePages[0]);
+    EXPECT_EQ(&hugePages[0], set.fullest());
+    EXPECT_TRUE(hugePages[0].isBacked());
+
+    // Two pages in use beats one.
+    set.takeFreePage(&hugePages[1]);
+    set.takeFreePage(&hugePages[1]);
+    EXPECT_EQ(&hugePages[1], set.fullest());
+
+    // A huge page whose pages are all free comes after those in use, but
+    // before one that isn't backed.
+    set.freePage(&hugePages[0], 0, 0);
+    set.freePage(&hugePages[1], 0, 0);
+    set.freePage(&hugePages[1], 1, 0);
+    EXPECT_EQ(&hugePages[1], set.fullest());
+    EXPECT_TRUE(set.hasFreeHugePages());
+
+    // The first huge page to become free is the first to go idle.
+    EXPECT_EQ(nullptr, set.takeIdleHugePage(5, std::chrono::milliseconds(10)));
+    EXPECT_EQ(&hugePages[0], set.takeIdleHugePage(10, std::chrono::milliseconds(10)));
+    EXPECT_EQ(&hugePages[1], set.takeIdleHugePage(10, std::chrono::milliseconds(10)));
+    EXPECT_FALSE(set.hasFreeHugePages());
+    EXPECT_EQ(&hugePages[2], set.fullest());
+}
+
+TEST(HugePage, PacksIntoFullestHugePage)
+{
+    VMHeap vmHeap(0, true);
+
+    // Fill the first huge page, and start on the next one.
+    std::vector<SmallPage*> pages;
+    pages.push_back(vmHeap.allocateSmallPage());
+    HugePage* first = hugePage(pages[0]);
+    while (first->freePageCount())
+        pages.push_back(vmHeap.allocateSmallPage());
+    SmallPage* second = vmHeap.allocateSmallPage();
+    EXPECT_NE(first, hugePage(second));
+
+    SmallPage* page = pages[pages.size() / 2];
+    vmHeap.deallocateSmallPage(page);
+    EXPECT_EQ(page, vmHeap.allocateSmallPage());
+
+    HugePageStatistics statistics = vmHeap.hugePageStatistics();
+    EXPECT_EQ(2u, statistics.backedHugePageCount);
+    EXPECT_EQ((pages.size() + 1) * vmPageSize, statistics.usedBytes);
+}
+
+TEST(HugePage, ReleasesOnlyWholeHugePages)
+{
+    VMHeap vmHeap(0, true);
+
+    std::vector<SmallPage*> pages;
+    for (size_t i = 0; i < 8; ++i) {
+        pages.push_back(vmHeap.allocateSmallPage());
+        memset(pages.back()->begin()->begin(), 'a', vmPageSize);
+        EXPECT_EQ(hugePage(pages[0]), hugePage(pages.back()));
+    }
+
+    vmHeap.deallocatePages(pages.data(), pages.size() - 1);
+    EXPECT_FALSE(vmHeap.decommitIdlePages(std::chrono::milliseconds(0)));
+    EXPECT_EQ(1u, vmHeap.hugePageStatistics().backedHugePageCount);
+    EXPECT_TRUE(isResident(pages[0]->begin()->begin()));
+
+    vmHeap.deallocateSmallPage(pages.back());
+    EXPECT_TRUE(vmHeap.decommitIdlePages(std::chrono::hours(1)));
+    EXPECT_FALSE(vmHeap.decommitIdlePages(std::chrono::milliseconds(0)));
+
+    HugePageStatistics statistics = vmHeap.hugePageStatistics();
+    EXPECT_EQ(0u, statistics.backedHugePageCount);
+    EXPECT_EQ(0u, statistics.usedBytes);
+    EXPECT_EQ(0u, statistics.freeBytes);
+    for (SmallPage* page : pages)
+        EXPECT_FALSE(isResident(page->begin()->begin()));
+}
@@ -0,0 +1,98 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/HugeTLBPool.h>
+#include <bmalloc/bmalloc.h>
+#include <cstdio>
+#include <cstring>
+
+using namespace bmalloc;
+
+static size_t readHugeTLBPageCount(const char* name)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/kernel/mm/hugepages/hugepages-2048kB/%s", name);
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return 0;
+    unsigned long count = 0;
+    if (fscanf(file, "%lu", &count) != 1)
+        count = 0;
+    fclose(file);
+    return count;
+}
+
+// How many 2MB huge pages the host has reserved that nobody has mapped.
+static size_t freeHugeTLBPageCount()
+{
+    return readHugeTLBPageCount("free_hugepages") - readHugeTLBPageCount("resv_hugepages");
+}
+
+TEST(HugeTLBPool, DisabledByDefault)
+{
+    HugeTLBPool pool(0, hugePageSize);
+    EXPECT_FALSE(!!pool.tryAllocate(superChunkSize, superChunkSize));
+    EXPECT_EQ(0u, pool.usedBytes());
+}
+
+TEST(HugeTLBPool, StaysWithinPoolSize)
+{
+    HugeTLBPool pool(4 * MB, hugePageSize);
+    EXPECT_FALSE(!!pool.tryAllocate(superChunkSize, 8 * MB));
+    EXPECT_EQ(0u, pool.usedBytes());
+}
+
+TEST(HugeTLBPool, RefusesWastefulRounding)
+{
+    HugeTLBPool pool(4096 * MB, 1024 * MB);
+    EXPECT_FALSE(!!pool.tryAllocate(superChunkSize, superChunkSize));
+    EXPECT_EQ(0u, pool.usedBytes());
+}
+
+TEST(HugeTLBPool, MapsHugePagesOrFallsBack)
+{
+    HugeTLBPool pool(4 * MB, hugePageSize);
+    bool hasHugePages = freeHugeTLBPageCount() >= 2;
+
+    Range range = pool.tryAllocate(superChunkSize, 4 * MB);
+    EXPECT_EQ(hasHugePages, !!range);
+    if (!range) {
+        EXPECT_EQ(0u, pool.usedBytes());
+        return;
+    }
+
+    EXPECT_EQ(4 * MB, range.size());
+    EXPECT_FALSE(test(range.begin(), superChunkSize - 1));
+    EXPECT_EQ(4 * MB, pool.usedBytes());
+    memset(range.begin(), 'a', range.size());
+
+    // The pool is used up.
+    EXPECT_FALSE(!!pool.tryAllocate(superChunkSize, 2 * MB));
+
+    pool.deallocate(range);
+    EXPECT_EQ(0u, pool.usedBytes());
+}
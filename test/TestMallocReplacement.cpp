@@ -0,0 +1,150 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+// Only Linux builds libbmalloc.so, and passes us its path.
+#ifdef BMALLOC_SHARED_LIBRARY
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <malloc.h>
+#include <spawn.h>
+#include <string>
+#include <sys/wait.h>
+#include <vector>
+
+extern char** environ;
+
+// Set in the child that TestMallocReplacement.Preloaded runs in.
+static const char* const childVariable = "BMALLOC_TEST_PRELOADED_CHILD";
+
+static bool isAligned(void* object, size_t alignment)
+{
+    return !(reinterpret_cast<uintptr_t>(object) % alignment);
+}
+
+// Too big for any address space, so it can't be mapped.
+static const size_t hugeSize = static_cast<size_t>(1) << 62;
+
+TEST(TestMallocReplacement, Preloaded) {
+    if (getenv(childVariable)) {
+        // This is the child: exercise the preloaded allocator. gtest and the
+        // C++ runtime have been allocating through it since startup, too.
+        Dl_info info;
+        ASSERT_TRUE(dladdr(reinterpret_cast<void*>(&malloc), &info));
+        EXPECT_NE(nullptr, strstr(info.dli_fname, "libbmalloc"));
+
+        std::vector<char*> objects;
+        for (size_t size = 1; size <= 64 * 1024 * 1024; size = size * 3 + 1) {
+            char* object = static_cast<char*>(malloc(size));
+            ASSERT_NE(nullptr, object);
+            EXPECT_TRUE(isAligned(object, 16) || size <= 8);
+            EXPECT_LE(size, malloc_usable_size(object));
+            memset(object, static_cast<int>(size), size);
+            objects.push_back(object);
+        }
+        for (char* object : objects)
+            free(object);
+
+        char* object = static_cast<char*>(malloc(100));
+        memset(object, 'a', 100);
+        for (size_t size = 200; size <= 16 * 1024 * 1024; size *= 4) {
+            object = static_cast<char*>(realloc(object, size));
+            ASSERT_NE(nullptr, object);
+            EXPECT_EQ('a', object[0]);
+            EXPECT_EQ('a', object[99]);
+        }
+        object = static_cast<char*>(realloc(object, 50));
+        EXPECT_EQ('a', object[49]);
+        free(object);
+
+        for (size_t alignment = sizeof(void*); alignment <= 4 * 1024 * 1024; alignment *= 4) {
+            void* result = nullptr;
+            EXPECT_EQ(0, posix_memalign(&result, alignment, 1000));
+            EXPECT_TRUE(isAligned(result, alignment));
+            free(result);
+
+            result = aligned_alloc(alignment, alignment * 3);
+            EXPECT_TRUE(isAligned(result, alignment));
+            free(result);
+
+            result = memalign(alignment, 10);
+            EXPECT_TRUE(isAligned(result, alignment));
+            free(result);
+        }
+        void* page = valloc(5000);
+        EXPECT_TRUE(isAligned(page, 4096));
+        free(page);
+
+        // Running out of memory is an error, not a crash.
+        void* result = nullptr;
+        EXPECT_EQ(ENOMEM, posix_memalign(&result, 64, hugeSize));
+        EXPECT_EQ(nullptr, result);
+
+        errno = 0;
+        EXPECT_EQ(nullptr, aligned_alloc(64, hugeSize));
+        EXPECT_EQ(ENOMEM, errno);
+
+        errno = 0;
+        EXPECT_EQ(nullptr, memalign(64, hugeSize));
+        EXPECT_EQ(ENOMEM, errno);
+
+        errno = 0;
+        EXPECT_EQ(nullptr, valloc(hugeSize));
+        EXPECT_EQ(ENOMEM, errno);
+
+        errno = 0;
+        EXPECT_EQ(nullptr, malloc(hugeSize));
+        EXPECT_EQ(ENOMEM, errno);
+        return;
+    }
+
+    std::vector<std::string> environment;
+    for (char** variable = environ; *variable; ++variable)
+        environment.push_back(*variable);
+    environment.push_back(std::string("LD_PRELOAD=") + BMALLOC_SHARED_LIBRARY);
+    environment.push_back(std::string(childVariable) + "=1");
+
+    std::vector<char*> envp;
+    for (std::string& variable : environment)
+        envp.push_back(&variable[0]);
+    envp.push_back(nullptr);
+
+    std::string filter = "--gtest_filter=TestMallocReplacement.Preloaded";
+    char* argv[] = { const_cast<char*>("unit_tests"), &filter[0], nullptr };
+
+    pid_t pid;
+    ASSERT_EQ(0, posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, argv, envp.data()));
+
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+#endif // BMALLOC_SHARED_LIBRARY
@@ -0,0 +1,79 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/Map.h>
+#include <bmalloc/Range.h>
+
+using namespace bmalloc;
+
+struct TestHash {
+    static size_t hash(void* key) { return reinterpret_cast<uintptr_t>(key) >> 4; }
+};
+
+static void* key(size_t i)
+{
+    return reinterpret_cast<void*>((i + 1) * 16);
+}
+
+TEST(TestMap, AddFindTake) {
+    Map<void*, Range, TestHash> map;
+    EXPECT_EQ(nullptr, map.find(key(0)));
+
+    for (size_t i = 0; i < 10000; ++i)
+        map.add(key(i), Range(key(i), i));
+    EXPECT_EQ(10000u, map.size());
+
+    for (size_t i = 0; i < 10000; ++i) {
+        Range* range = map.find(key(i));
+        ASSERT_NE(nullptr, range);
+        EXPECT_EQ(i, range->size());
+    }
+
+    // Take every other key, so later keys must survive holes in their probe sequence.
+    for (size_t i = 0; i < 10000; i += 2)
+        EXPECT_EQ(i, map.take(key(i)).size());
+    for (size_t i = 0; i < 10000; ++i)
+        EXPECT_EQ(i % 2, !!map.find(key(i))) << i;
+
+    for (size_t i = 1; i < 10000; i += 2)
+        map.take(key(i));
+    EXPECT_EQ(0u, map.size());
+}
+
+struct CollidingHash {
+    static size_t hash(void*) { return 0; }
+};
+
+TEST(TestMap, Collisions) {
+    Map<void*, Range, CollidingHash> map;
+    for (size_t i = 0; i < 100; ++i)
+        map.add(key(i), Range(key(i), i));
+
+    for (size_t i = 0; i < 100; i += 3)
+        map.take(key(i));
+    for (size_t i = 0; i < 100; ++i)
+        EXPECT_EQ(!!(i % 3), !!map.find(key(i))) << i;
+}
@@ -0,0 +1,80 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <bmalloc/ObjectType.h>
+#include <helper/API.h>
+
+using namespace bmalloc;
+
+TEST(TestMediumLarge, SizeClasses) {
+    for (size_t size = mediumMax + 1; size <= mediumLargeMax; ++size) {
+        size_t sizeClass = mediumLargeSizeClass(size);
+        ASSERT_LT(sizeClass, sizeClassCount);
+        ASSERT_LE(size, objectSize(sizeClass));
+        ASSERT_TRUE(sizeClass == mediumSizeClassCount || objectSize(sizeClass - 1) < size);
+    }
+    EXPECT_EQ(mediumLargeMax, objectSize(sizeClassCount - 1));
+}
+
+TEST(TestMediumLarge, AllocateAndFree) {
+    std::vector<void*> objects;
+    std::thread producer([&objects]() {
+        for (size_t size = mediumMax + 1; size <= mediumLargeMax; size += 509) {
+            for (int i = 0; i < 8; ++i) {
+                void* object = api::malloc(size);
+                EXPECT_EQ(MediumLarge, objectType(object));
+                memset(object, i, size);
+                objects.push_back(object);
+            }
+        }
+    });
+    producer.join();
+
+    // Free on another thread, so the objects go back to their shard remotely.
+    std::thread consumer([&objects]() {
+        for (void* object : objects)
+            api::free(object);
+    });
+    consumer.join();
+    api::scavenge();
+}
+
+TEST(TestMediumLarge, Reallocate) {
+    char* object = static_cast<char*>(api::malloc(2000));
+    memset(object, 'a', 2000);
+    object = static_cast<char*>(api::realloc(object, 30000));
+    EXPECT_EQ(MediumLarge, objectType(object));
+    for (size_t i = 0; i < 2000; ++i)
+        ASSERT_EQ('a', object[i]);
+
+    object = static_cast<char*>(api::realloc(object, 100));
+    EXPECT_EQ(Small, objectType(object));
+    EXPECT_EQ('a', object[99]);
+    api::free(object);
+}
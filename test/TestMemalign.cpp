@@ -0,0 +1,89 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/ObjectType.h>
+#include <bmalloc/Sizes.h>
+#include <cstdint>
+#include <cstring>
+#include <helper/API.h>
+#include <vector>
+
+using namespace bmalloc;
+
+TEST(TestMemalign, SizeClassesKeepTheirAlignment) {
+    for (size_t sizeClass = 0; sizeClass < sizeClassCount; ++sizeClass) {
+        size_t size = objectSize(sizeClass);
+        size_t alignment = objectAlignment(sizeClass);
+        std::vector<void*> objects;
+        for (size_t i = 0; i < 256; ++i) {
+            void* object = api::malloc(size);
+            EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(object) % alignment) << "size " << size;
+            objects.push_back(object);
+        }
+        for (void* object : objects)
+            api::free(object);
+    }
+}
+
+TEST(TestMemalign, AlignedSizeIsAnObjectSize) {
+    EXPECT_EQ(256u, alignedObjectSize(64, 256));
+    EXPECT_EQ(256u, alignedObjectSize(64, 200));
+    EXPECT_EQ(64u, alignedObjectSize(64, 0));
+    EXPECT_EQ(1536u, alignedObjectSize(512, 1100));
+    EXPECT_EQ(0u, alignedObjectSize(64, mediumLargeMax + 1));
+
+    for (size_t alignment = Sizes::alignment; alignment <= mediumLargePageSize * 2; alignment *= 2) {
+        for (size_t size = 0; size <= mediumLargeMax; size += 24) {
+            size_t alignedSize = alignedObjectSize(alignment, size);
+            if (!alignedSize)
+                continue;
+            EXPECT_GE(alignedSize, size);
+            size_t sizeClass = alignedSize <= mediumMax ? bmalloc::sizeClass(alignedSize) : mediumLargeSizeClass(alignedSize);
+            EXPECT_EQ(alignedSize, objectSize(sizeClass));
+            EXPECT_GE(objectAlignment(sizeClass), alignment);
+        }
+    }
+}
+
+TEST(TestMemalign, AlignedObjectsComeFromSizeClasses) {
+    for (size_t alignment = Sizes::alignment; alignment <= 64 * 1024; alignment *= 2) {
+        for (size_t size = 1; size <= 48 * 1024; size = size * 3 / 2 + 1) {
+            std::vector<void*> objects;
+            for (size_t i = 0; i < 16; ++i) {
+                void* object = api::memalign(alignment, size);
+                ASSERT_TRUE(object);
+                EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(object) % alignment) << alignment << " " << size;
+                if (alignedObjectSize(alignment, size)) {
+                    EXPECT_LT(objectType(object), Large);
+                }
+                memset(object, 'a', size);
+                objects.push_back(object);
+            }
+            for (void* object : objects)
+                api::free(object);
+        }
+    }
+}
@@ -0,0 +1,109 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <helper/API.h>
+#include <vector>
+
+TEST(TestRealloc, SameSizeClassIsInPlace) {
+    void* object = bmalloc::api::malloc(200);
+    memset(object, 'a', 200);
+    void* newObject = bmalloc::api::realloc(object, 190);
+    EXPECT_EQ(object, newObject);
+    newObject = bmalloc::api::realloc(newObject, 200);
+    EXPECT_EQ(object, newObject);
+    EXPECT_EQ('a', static_cast<char*>(newObject)[199]);
+    bmalloc::api::free(newObject);
+
+    object = bmalloc::api::malloc(20000);
+    newObject = bmalloc::api::realloc(object, 18000);
+    EXPECT_EQ(object, newObject);
+    bmalloc::api::free(newObject);
+}
+
+TEST(TestRealloc, GrowAndBigShrinkMove) {
+    char* object = static_cast<char*>(bmalloc::api::malloc(200));
+    memset(object, 'a', 200);
+    char* newObject = static_cast<char*>(bmalloc::api::realloc(object, 600));
+    EXPECT_NE(object, newObject);
+    EXPECT_EQ('a', newObject[199]);
+
+    object = newObject;
+    newObject = static_cast<char*>(bmalloc::api::realloc(object, 100));
+    EXPECT_NE(object, newObject);
+    EXPECT_EQ('a', newObject[99]);
+    bmalloc::api::free(newObject);
+}
+
+TEST(TestRealloc, LargeGrowsIntoFreeNeighbor) {
+    const size_t size = 64 * 1024;
+
+    // Earlier tests may have left fragments in the free list, so keep going
+    // until two objects come out adjacent.
+    std::vector<char*> fragments;
+    char* object = static_cast<char*>(bmalloc::api::malloc(size));
+    char* neighbor = static_cast<char*>(bmalloc::api::malloc(size));
+    while (object + size != neighbor && fragments.size() < 1024) {
+        fragments.push_back(object);
+        object = neighbor;
+        neighbor = static_cast<char*>(bmalloc::api::malloc(size));
+    }
+    ASSERT_EQ(object + size, neighbor);
+    memset(object, 'a', size);
+
+    bmalloc::api::free(neighbor);
+    EXPECT_EQ(object, bmalloc::api::realloc(object, 2 * size));
+    EXPECT_EQ('a', object[size - 1]);
+    memset(object, 'b', 2 * size);
+
+    // The grown object is intact and can be freed as usual.
+    object = static_cast<char*>(bmalloc::api::realloc(object, 3 * size));
+    EXPECT_EQ('b', object[2 * size - 1]);
+    bmalloc::api::free(object);
+    for (char* fragment : fragments)
+        bmalloc::api::free(fragment);
+}
+
+TEST(TestRealloc, XLargeGrowKeepsContents) {
+    const size_t size = 32 * 1024 * 1024;
+    char* object = static_cast<char*>(bmalloc::api::malloc(size));
+    object[0] = 'a';
+    object[size - 1] = 'b';
+
+    // Block the address space after us, so the grow can't extend in place.
+    char* blocker = static_cast<char*>(bmalloc::api::malloc(size));
+    for (int i = 1; i <= 4; ++i) {
+        object = static_cast<char*>(bmalloc::api::realloc(object, (i + 1) * size));
+        EXPECT_EQ('a', object[0]);
+        EXPECT_EQ('b', object[size - 1]);
+        object[(i + 1) * size - 1] = 'c';
+    }
+
+    object = static_cast<char*>(bmalloc::api::realloc(object, 2 * size));
+    EXPECT_EQ('b', object[size - 1]);
+    bmalloc::api::free(object);
+    bmalloc::api::free(blocker);
+}
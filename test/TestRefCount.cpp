@@ -0,0 +1,85 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/bmalloc.h>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace bmalloc;
+
+// Drops an object's line reference the way the deallocator does: without a
+// lock, unless it might be the last reference.
+static void derefLine(void* object)
+{
+    SmallLine* line = SmallLine::get(object);
+    if (line->tryDeref())
+        return;
+
+    Heap* heap = PerShard<Heap>::get(Heap::shard(object));
+    std::lock_guard<StaticMutex> lock(heap->smallMutex(SmallPage::get(line)->sizeClass()));
+    heap->derefSmallLine(lock, line);
+}
+
+TEST(TestRefCount, ConcurrentDerefsOfSharedLines) {
+    // Four objects of this size share each line. No other test uses this
+    // size class, so its lines hold only our objects.
+    const size_t size = 64;
+    const size_t threadCount = 4;
+
+    std::vector<void*> objects(4096);
+    for (void*& object : objects)
+        object = api::malloc(size);
+
+    // Drop the references caches hold to objects we haven't allocated, so
+    // our objects hold every reference to their lines.
+    api::scavenge();
+
+    std::set<SmallLine*> lines;
+    for (void* object : objects)
+        lines.insert(SmallLine::get(object));
+    for (SmallLine* line : lines)
+        EXPECT_NE(0u, line->refCount());
+
+    // Threads take turns with neighboring objects, so they all drop
+    // references to the same lines at once, and race to drop the last one.
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&objects, t, threadCount]() {
+            for (size_t i = t; i < objects.size(); i += threadCount)
+                derefLine(objects[i]);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    // A lost update would leave a reference behind, and a double release
+    // would trip the underflow assertion in debug builds.
+    for (SmallLine* line : lines) {
+        EXPECT_EQ(0u, line->refCount());
+        EXPECT_EQ(0u, SmallPage::get(line)->refCount());
+    }
+}
@@ -0,0 +1,93 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/BumpRange.h>
+#include <thread>
+#include <vector>
+#include <helper/API.h>
+
+using namespace bmalloc;
+
+TEST(TestRefill, RefillsPerSecond) {
+    bmalloc::api::refillsPerSecond(48);
+
+    // Run on a fresh thread, so its caches start out empty.
+    std::thread thread([]() {
+        std::vector<void*> objects;
+        for (int i = 0; i < 10000; ++i)
+            objects.push_back(bmalloc::api::malloc(48));
+        for (void* object : objects)
+            bmalloc::api::free(object);
+    });
+    thread.join();
+
+    EXPECT_LT(0, bmalloc::api::refillsPerSecond(48));
+}
+
+TEST(TestRefill, SlowStartDoublesBackToBackRefills) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point refillTime;
+    unsigned char pageCount = 1;
+
+    // The first refill follows a quiet period.
+    EXPECT_EQ(1u, slowStartRefillPageCount(pageCount, refillTime, now));
+    EXPECT_EQ(now, refillTime);
+
+    size_t expected = 1;
+    for (size_t i = 0; i < 4; ++i) {
+        now += bumpRangeCacheRefillInterval / 2;
+        expected = std::min(expected * 2, bumpRangeCacheRefillPageCountMax);
+        EXPECT_EQ(expected, slowStartRefillPageCount(pageCount, refillTime, now));
+    }
+    EXPECT_EQ(bumpRangeCacheRefillPageCountMax, pageCount);
+}
+
+TEST(TestRefill, QuietPeriodDecaysRefills) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point refillTime = now;
+    unsigned char pageCount = bumpRangeCacheRefillPageCountMax;
+
+    for (size_t expected = bumpRangeCacheRefillPageCountMax / 2; expected; expected /= 2) {
+        now += bumpRangeCacheRefillInterval;
+        EXPECT_EQ(expected, slowStartRefillPageCount(pageCount, refillTime, now));
+    }
+
+    now += bumpRangeCacheRefillInterval;
+    EXPECT_EQ(1u, slowStartRefillPageCount(pageCount, refillTime, now));
+}
+
+TEST(TestRefill, BudgetClampsRefills) {
+    size_t pageCount = bumpRangeCacheRefillPageCountMax;
+    size_t pageSize = bumpRangeCacheBudget / pageCount;
+
+    EXPECT_EQ(pageCount, budgetedRefillPageCount(pageCount, pageSize, 0));
+    EXPECT_EQ(pageCount / 2, budgetedRefillPageCount(pageCount, pageSize, 1));
+    EXPECT_EQ(pageCount / 2, budgetedRefillPageCount(pageCount, pageSize, bumpRangeCacheBudget / 2));
+    EXPECT_EQ(1u, budgetedRefillPageCount(pageCount, pageSize, bumpRangeCacheBudget / 2 + 1));
+
+    // A thread over its budget still gets a page.
+    EXPECT_EQ(1u, budgetedRefillPageCount(pageCount, pageSize, 2 * bumpRangeCacheBudget));
+}
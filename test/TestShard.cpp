@@ -0,0 +1,165 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+#include <helper/API.h>
+
+static const size_t sizes[] = { 16, 200, 800, 4096, 64 * 1024, 20 * 1024 * 1024 };
+
+TEST(TestShard, CrossThreadFree) {
+    // Threads are bound to different shards, so freeing on another thread
+    // routes every object back to the shard that allocated it.
+    std::vector<void*> objects;
+    std::thread producer([&objects]() {
+        for (size_t size : sizes) {
+            for (int i = 0; i < 10; ++i) {
+                void* object = bmalloc::api::malloc(size);
+                memset(object, i, size);
+                objects.push_back(object);
+            }
+        }
+    });
+    producer.join();
+
+    for (void* object : objects)
+        bmalloc::api::free(object);
+    bmalloc::api::scavenge();
+}
+
+TEST(TestShard, ConcurrentAllocation) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 16; ++t) {
+        threads.emplace_back([t]() {
+            std::vector<unsigned char*> objects;
+            for (int i = 0; i < 10000; ++i) {
+                size_t size = sizes[i % 5];
+                unsigned char* object = static_cast<unsigned char*>(bmalloc::api::malloc(size));
+                object[0] = object[size - 1] = static_cast<unsigned char>(t);
+                objects.push_back(object);
+            }
+            for (unsigned char* object : objects) {
+                EXPECT_EQ(t, object[0]);
+                bmalloc::api::free(object);
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+}
+
+TEST(TestShard, RemoteFreesAreReclaimed) {
+    // A consumer on another shard frees the producer's objects. The producer's
+    // next refill should reclaim them from its shard's remote free list.
+    std::thread producer([]() {
+        std::vector<void*> objects;
+        for (int i = 0; i < 1000; ++i)
+            objects.push_back(bmalloc::api::malloc(32));
+
+        std::thread consumer([&objects]() {
+            for (void* object : objects)
+                bmalloc::api::free(object);
+            bmalloc::api::scavengeThisThread();
+        });
+        consumer.join();
+
+        bmalloc::api::scavengeThisThread();
+        size_t reused = 0;
+        std::vector<void*> newObjects;
+        for (int i = 0; i < 1000; ++i) {
+            void* object = bmalloc::api::malloc(32);
+            reused += std::find(objects.begin(), objects.end(), object) != objects.end();
+            newObjects.push_back(object);
+        }
+        EXPECT_LT(0u, reused);
+
+        for (void* object : newObjects)
+            bmalloc::api::free(object);
+    });
+    producer.join();
+}
+
+TEST(TestShard, RemoteFreesToAnIdleShardAreReclaimed) {
+    // Per-CPU caches free through the CPU's log instead of the thread's
+    // shard, so there's no remote free to wait for.
+    if (bmalloc::PerShard<bmalloc::Heap>::get(0)->environment().isPerCPUCacheEnabled())
+        return;
+
+    // No other test uses this size class, so its lines hold only our objects.
+    const size_t size = 152;
+
+    // The producer's shard has no threads left to refill from it, so only
+    // its scavenger can take back the objects the consumer frees.
+    std::vector<void*> objects(4096);
+    size_t producerShard;
+    std::thread producer([&objects, &producerShard]() {
+        for (void*& object : objects)
+            object = bmalloc::api::malloc(size);
+        producerShard = bmalloc::PerThread<bmalloc::Cache>::get()->deallocator().heap()->shard();
+    });
+    producer.join();
+
+    // Drop the references caches hold to objects nobody allocated. Nothing
+    // has been freed yet, so this doesn't process any remote frees for us.
+    bmalloc::api::scavenge();
+
+    std::set<bmalloc::SmallLine*> lines;
+    for (void* object : objects) {
+        EXPECT_EQ(producerShard, bmalloc::Heap::shard(object));
+        lines.insert(bmalloc::SmallLine::get(object));
+    }
+
+    std::thread consumer([&objects, producerShard]() {
+        ASSERT_NE(producerShard, bmalloc::PerThread<bmalloc::Cache>::get()->deallocator().heap()->shard());
+        for (void* object : objects)
+            bmalloc::api::free(object);
+        bmalloc::api::scavengeThisThread();
+    });
+    consumer.join();
+
+    auto isReclaimed = [&lines]() {
+        for (bmalloc::SmallLine* line : lines) {
+            if (line->refCount() || bmalloc::SmallPage::get(line)->refCount())
+                return false;
+        }
+        return true;
+    };
+
+    // The deadline only keeps a regression from hanging the test.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!isReclaimed() && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // Every line went back to the producer's shard, and took its page along.
+    for (bmalloc::SmallLine* line : lines) {
+        EXPECT_EQ(0u, line->refCount());
+        EXPECT_EQ(0u, bmalloc::SmallPage::get(line)->refCount());
+    }
+}
@@ -0,0 +1,192 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+#include <helper/API.h>
+#include <helper/BAllocator.h>
+
+using namespace bmalloc;
+
+static const size_t sizes[] = { 0, 1, 16, 200, 800, 1024, 1025, 4096, 20000, 32 * 1024, 64 * 1024, 20 * 1024 * 1024 };
+
+// Expects every small, medium and medium-large object's line, and its page,
+// to have given up all its references.
+static void expectLinesAreFree(const std::vector<void*>& objects)
+{
+    for (void* object : objects) {
+        switch (objectType(object)) {
+        case Small:
+            EXPECT_EQ(0u, SmallLine::get(object)->refCount());
+            EXPECT_EQ(0u, SmallPage::get(SmallLine::get(object))->refCount());
+            break;
+        case Medium:
+            EXPECT_EQ(0u, MediumLine::get(object)->refCount());
+            EXPECT_EQ(0u, MediumPage::get(MediumLine::get(object))->refCount());
+            break;
+        case MediumLarge:
+            EXPECT_EQ(0u, MediumLargeLine::get(object)->refCount());
+            EXPECT_EQ(0u, MediumLargePage::get(MediumLargeLine::get(object))->refCount());
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+TEST(TestSizedFree, FreeSized) {
+    for (size_t size : sizes) {
+        std::vector<void*> objects;
+        for (int i = 0; i < 100; ++i) {
+            void* object = api::malloc(size);
+            memset(object, i, std::min<size_t>(size, 4096));
+            objects.push_back(object);
+        }
+        for (void* object : objects)
+            api::freeSized(object, size);
+    }
+    api::freeSized(nullptr, 16);
+}
+
+TEST(TestSizedFree, FreeSizedReleasesLines) {
+    // No other test uses these small, medium and medium-large size classes,
+    // so their lines hold only our objects.
+    static const size_t lineSizes[] = { 136, 936, 6000 };
+    std::vector<void*> objects;
+    for (size_t size : lineSizes) {
+        for (int i = 0; i < 100; ++i)
+            objects.push_back(api::malloc(size));
+    }
+    EXPECT_EQ(Small, objectType(objects.front()));
+    EXPECT_EQ(Medium, objectType(objects[100]));
+    EXPECT_EQ(MediumLarge, objectType(objects.back()));
+
+    for (size_t i = 0; i < objects.size(); ++i)
+        api::freeSized(objects[i], lineSizes[i / 100]);
+    api::scavenge();
+
+    expectLinesAreFree(objects);
+}
+
+TEST(TestSizedFree, FreeSizedAfterRealloc) {
+    void* object = api::malloc(16);
+    for (size_t size : sizes)
+        object = api::realloc(object, size);
+    api::freeSized(object, sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+
+    object = api::malloc(64 * 1024);
+    object = api::realloc(object, 40 * 1024);
+    api::freeSized(object, 40 * 1024);
+
+    // Shrinking in place keeps the object in its size class, and in a
+    // bigger object type than the new size implies, so the free has to
+    // take both from the object.
+    void* medium = api::malloc(1000);
+    EXPECT_EQ(medium, api::realloc(medium, 600));
+    EXPECT_EQ(Medium, objectType(medium));
+    api::freeSized(medium, 600);
+
+    void* mediumLarge = api::malloc(7000);
+    EXPECT_EQ(mediumLarge, api::realloc(mediumLarge, 4000));
+    EXPECT_EQ(MediumLarge, objectType(mediumLarge));
+    api::freeSized(mediumLarge, 4000);
+}
+
+TEST(TestSizedFree, FreeSizedOnAnotherThread) {
+    std::vector<void*> objects;
+    std::thread producer([&objects]() {
+        for (int i = 0; i < 1000; ++i)
+            objects.push_back(api::malloc(48));
+    });
+    producer.join();
+
+    std::set<size_t> shards;
+    for (void* object : objects) {
+        EXPECT_EQ(48u, api::usableSize(object));
+        shards.insert(Heap::shard(object));
+        api::freeSized(object, 48);
+    }
+    EXPECT_EQ(1u, shards.size());
+}
+
+TEST(TestSizedFree, FreesBatchBySizeClass) {
+    // Per-CPU caches don't free through the thread's object log.
+    if (PerShard<Heap>::get(0)->environment().isPerCPUCacheEnabled())
+        return;
+
+    // No other test uses these size classes, so their transfer caches hold
+    // only our batches.
+    static const size_t batchSizes[] = { 144, 176 };
+    std::thread([]() {
+        std::vector<void*> objects;
+        for (size_t i = 0; i < 2 * bumpRangeCacheCapacity; ++i) {
+            for (size_t size : batchSizes)
+                objects.push_back(api::malloc(size));
+        }
+        std::vector<void*> filler;
+        for (size_t i = 0; i < deallocatorLogCapacity; ++i)
+            filler.push_back(api::malloc(16));
+
+        // Interleaved frees of the two sizes fill the object log, and the
+        // filler flushes it.
+        for (size_t i = 0; i < objects.size(); ++i)
+            api::freeSized(objects[i], batchSizes[i % 2]);
+        for (void* object : filler)
+            api::freeSized(object, 16);
+
+        // Each size class's objects went to its transfer cache as full batches.
+        Heap* heap = PerThread<Cache>::get()->deallocator().heap();
+        for (size_t i = 0; i < 2; ++i) {
+            std::set<void*> freed;
+            for (size_t j = i; j < objects.size(); j += 2)
+                freed.insert(objects[j]);
+
+            TransferCache& transferCache = heap->transferCache(sizeClass(batchSizes[i]));
+            BumpRangeCache batch;
+            size_t count = 0;
+            while (transferCache.tryPop(batch)) {
+                EXPECT_EQ(bumpRangeCacheCapacity, batch.size());
+                for (auto& bumpRange : batch) {
+                    EXPECT_EQ(1u, freed.count(bumpRange.begin));
+                    heap->derefLine(bumpRange.begin);
+                    ++count;
+                }
+                batch.clear();
+            }
+            EXPECT_EQ(freed.size(), count);
+        }
+    }).join();
+}
+
+TEST(TestSizedFree, Allocator) {
+    std::vector<int, BAllocator<int>> vector;
+    for (int i = 0; i < 100000; ++i)
+        vector.push_back(i);
+    EXPECT_EQ(99999, vector.back());
+}
@@ -0,0 +1,92 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/Mutex.h>
+#include <bmalloc/StaticMutex.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace bmalloc;
+
+static StaticMutex s_mutex;
+
+TEST(StaticMutex, ZeroInitializedIsUnlocked)
+{
+    EXPECT_TRUE(s_mutex.try_lock());
+    EXPECT_FALSE(s_mutex.try_lock());
+    s_mutex.unlock();
+    EXPECT_TRUE(s_mutex.try_lock());
+    s_mutex.unlock();
+}
+
+TEST(StaticMutex, MutualExclusion)
+{
+    const size_t threadCount = 2 * std::max(2u, std::thread::hardware_concurrency());
+    const size_t iterations = 5000;
+
+    Mutex mutex;
+    size_t counter = 0;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < threadCount; ++i) {
+        threads.emplace_back([&] {
+            for (size_t j = 0; j < iterations; ++j) {
+                std::lock_guard<StaticMutex> lock(mutex);
+                size_t value = counter;
+                std::this_thread::yield();
+                counter = value + 1;
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_EQ(threadCount * iterations, counter);
+    EXPECT_GT(mutex.contendedLockCount(), 0u);
+    EXPECT_TRUE(mutex.try_lock());
+    mutex.unlock();
+}
+
+TEST(StaticMutex, UnlockWakesParkedThread)
+{
+    Mutex mutex;
+    mutex.lock();
+
+    bool didLock = false;
+    std::thread thread([&] {
+        std::lock_guard<StaticMutex> lock(mutex);
+        didLock = true;
+    });
+
+    // Hold the lock long enough for the waiter to give up spinning and park.
+    while (!mutex.parkCount())
+        std::this_thread::yield();
+    mutex.unlock();
+    thread.join();
+
+    EXPECT_TRUE(didLock);
+    EXPECT_EQ(1u, mutex.contendedLockCount());
+}
@@ -0,0 +1,105 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/Mutex.h>
+#include <bmalloc/TransferCache.h>
+#include <set>
+#include <thread>
+#include <vector>
+#include <helper/API.h>
+
+using namespace bmalloc;
+
+TEST(TestTransferCache, PushPop) {
+    static char buffer[1024];
+    Mutex mutex;
+    TransferCache transferCache;
+    transferCache.setMutex(mutex);
+    BumpRangeCache bumpRangeCache;
+    EXPECT_FALSE(transferCache.tryPop(bumpRangeCache));
+
+    for (size_t i = 0; i < transferCacheCapacity; ++i) {
+        bumpRangeCache.push({ buffer + i, static_cast<unsigned short>(i + 1) });
+        EXPECT_TRUE(transferCache.tryPush(bumpRangeCache));
+        EXPECT_EQ(0u, bumpRangeCache.size());
+    }
+
+    bumpRangeCache.push({ buffer, 1 });
+    EXPECT_FALSE(transferCache.tryPush(bumpRangeCache));
+    EXPECT_EQ(1u, bumpRangeCache.size());
+    bumpRangeCache.clear();
+
+    for (size_t i = transferCacheCapacity; i--; ) {
+        EXPECT_TRUE(transferCache.tryPop(bumpRangeCache));
+        ASSERT_EQ(1u, bumpRangeCache.size());
+        BumpRange bumpRange = bumpRangeCache.pop();
+        EXPECT_EQ(buffer + i, bumpRange.begin);
+        EXPECT_EQ(i + 1, bumpRange.objectCount);
+    }
+    EXPECT_FALSE(transferCache.tryPop(bumpRangeCache));
+}
+
+TEST(TestTransferCache, RefillTakesAnotherThreadsFreedBatch) {
+    // Per-CPU caches don't free through the thread's object log.
+    if (PerShard<Heap>::get(0)->environment().isPerCPUCacheEnabled())
+        return;
+
+    // No other test uses this size class, so only our refills count.
+    const size_t size = 168;
+
+    // Freeing a full batch's worth of objects hands them to the transfer
+    // cache, rather than back to their lines.
+    std::set<void*> freed;
+    size_t shard;
+    std::thread freer([&freed, &shard]() {
+        std::vector<void*> objects;
+        for (size_t i = 0; i < 2 * bumpRangeCacheCapacity; ++i)
+            objects.push_back(api::malloc(size));
+        for (void* object : objects) {
+            api::free(object);
+            freed.insert(object);
+        }
+        shard = PerThread<Cache>::get()->deallocator().heap()->shard();
+    });
+    freer.join();
+
+    // Threads take shards round-robin, so one of the next few shares the
+    // freer's shard, and refills from its transfer cache.
+    api::refillsPerSecond(size);
+    void* object = nullptr;
+    for (size_t i = 0; i < heapShardCount && !object; ++i) {
+        std::thread([&object, shard]() {
+            if (PerThread<Cache>::get()->deallocator().heap()->shard() != shard)
+                return;
+            object = api::malloc(size);
+            api::free(object);
+        }).join();
+    }
+
+    ASSERT_NE(nullptr, object);
+    EXPECT_EQ(1u, freed.count(object));
+    EXPECT_EQ(0, api::refillsPerSecond(size));
+}
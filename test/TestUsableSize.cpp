@@ -0,0 +1,62 @@
+/*
+  Copyright (C) 2015 Yusuke Suzuki <utatane.tea@gmail.com>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+
+#include <bmalloc/bmalloc.h>
+#include <cstring>
+
+using namespace bmalloc;
+
+TEST(TestUsableSize, MatchesGoodSize) {
+    for (size_t size = 1; size <= 64 * 1024 * 1024; size = size * 5 / 4 + 1) {
+        void* object = api::malloc(size);
+        size_t usableSize = api::usableSize(object);
+        EXPECT_GE(usableSize, size);
+        EXPECT_GE(usableSize, api::goodSize(size));
+        if (size <= mediumLargeMax) {
+            EXPECT_EQ(api::goodSize(size), usableSize) << size;
+        }
+        memset(object, 'a', usableSize);
+        api::free(object);
+    }
+}
+
+TEST(TestUsableSize, GoodSizeFillsTheSizeClass) {
+    EXPECT_EQ(8u, api::goodSize(1));
+    EXPECT_EQ(256u, api::goodSize(250));
+    EXPECT_EQ(1280u, api::goodSize(1025));
+    EXPECT_EQ(32u * 1024, api::goodSize(30 * 1024));
+
+    for (size_t size = 1; size <= 1024 * 1024; size += 97)
+        EXPECT_EQ(api::goodSize(size), api::goodSize(api::goodSize(size)));
+}
+
+TEST(TestUsableSize, ReallocInPlaceKeepsUsableSize) {
+    void* object = api::malloc(200);
+    size_t usableSize = api::usableSize(object);
+    object = api::realloc(object, 150);
+    EXPECT_EQ(usableSize, api::usableSize(object));
+    api::free(object);
+}